@@ -0,0 +1,45 @@
+/**********************************
+ * FILE NAME: AllocCount.cpp
+ *
+ * DESCRIPTION: Replacement of the global allocation functions that counts every allocation
+ **********************************/
+
+#include "AllocCount.h"
+#include <cstdlib>
+#include <new>
+#include <atomic>
+
+static std::atomic<long> allocations(0);
+
+long allocCount() {
+	return allocations.load(std::memory_order_relaxed);
+}
+
+void *operator new(size_t size) {
+	allocations.fetch_add(1, std::memory_order_relaxed);
+	void *p = malloc(size ? size : 1);
+	if ( NULL == p ) {
+		throw std::bad_alloc();
+	}
+	return p;
+}
+
+void *operator new[](size_t size) {
+	return operator new(size);
+}
+
+void operator delete(void *p) noexcept {
+	free(p);
+}
+
+void operator delete[](void *p) noexcept {
+	free(p);
+}
+
+void operator delete(void *p, size_t) noexcept {
+	free(p);
+}
+
+void operator delete[](void *p, size_t) noexcept {
+	free(p);
+}
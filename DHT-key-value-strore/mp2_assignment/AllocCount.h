@@ -0,0 +1,22 @@
+/**********************************
+ * FILE NAME: AllocCount.h
+ *
+ * DESCRIPTION: Count of heap allocations made by the process, for the allocation benchmark
+ **********************************/
+
+#ifndef _ALLOCCOUNT_H_
+#define _ALLOCCOUNT_H_
+
+/**
+ * Number of calls to operator new so far. Only counted in the AllocBench build, which links
+ * in AllocCount.o, and always 0 otherwise
+ */
+#ifdef ALLOCBENCH
+long allocCount();
+#else
+inline long allocCount() {
+	return 0;
+}
+#endif
+
+#endif /* _ALLOCCOUNT_H_ */
@@ -47,11 +47,42 @@ int main(int argc, char *argv[]) {
 Application::Application(char *infile) {
 	int i;
 	par = new Params();
-	srand (time(NULL));
 	par->setparams(infile);
+	srand(par->SEED);
+	// Node hashes its address with no Params at hand
+	Node::ringSize = par->RING_POSITIONS;
 	log = new Log(par);
-	en = new EmulNet(par);
-	en1 = new EmulNet(par);
+	if ( UDP_TRANSPORT == par->TRANSPORT ) {
+		// Membership and KV store traffic go to disjoint port ranges
+		en = new UdpNet(par, par->PORTNUM);
+		en1 = new UdpNet(par, par->PORTNUM + par->EN_GPSZ + 1);
+	}
+	else if ( SHM_TRANSPORT == par->TRANSPORT ) {
+		en = new ShmNet(par, par->SHM_NAME + ".mp1");
+		en1 = new ShmNet(par, par->SHM_NAME + ".mp2");
+	}
+	else {
+		en = new EmulNet(par);
+		en1 = new EmulNet(par);
+	}
+	// A recorded network trace covers the serial emulated network only
+	if ( EMUL_TRANSPORT == par->TRANSPORT && par->THREADS <= 1 ) {
+		if ( !par->RECORD_FILE.empty() ) {
+			en->ENrecord((par->RECORD_FILE + ".mp1").c_str());
+			en1->ENrecord((par->RECORD_FILE + ".mp2").c_str());
+		}
+		else if ( !par->REPLAY_FILE.empty() ) {
+			en->ENreplay((par->REPLAY_FILE + ".mp1").c_str());
+			en1->ENreplay((par->REPLAY_FILE + ".mp2").c_str());
+		}
+	}
+	// With SHIFT_TESTS the test schedule is placed once every node has joined, see run()
+	testShift = par->SHIFT_TESTS ? -1 : 0;
+	// Only the emulated network has lock-free mailboxes
+	pool = NULL;
+	if ( par->THREADS > 1 && EMUL_TRANSPORT == par->TRANSPORT ) {
+		pool = new WorkerPool(par->THREADS);
+	}
 	mp1 = (MP1Node **) malloc(par->EN_GPSZ * sizeof(MP1Node *));
 	mp2 = (MP2Node **) malloc(par->EN_GPSZ * sizeof(MP2Node *));
 
@@ -77,6 +108,7 @@ Application::Application(char *infile) {
  * Destructor
  */
 Application::~Application() {
+	delete pool;
 	delete log;
 	delete en;
 	delete en1;
@@ -100,27 +132,73 @@ int Application::run()
 	int timeWhenAllNodesHaveJoined = 0;
 	// boolean indicating if all nodes have joined
 	bool allNodesJoined = false;
-	srand(time(NULL));
+	// Heap allocations of each layer while the KV store runs, see AllocCount.h
+	long mp1Allocs = 0, mp2Allocs = 0, steadyTicks = 0;
+	srand(par->SEED);
+#ifdef ALLOCBENCH
+	FILE *allocs = fopen("allocs.log", "w");
+#endif
 
 	// As time runs along
-	for( par->globaltime = 0; par->globaltime < TOTAL_RUNNING_TIME; ++par->globaltime ) {
+	for( par->globaltime = 0; par->globaltime < TOTAL_RUNNING_TIME + max(testShift, 0); ++par->globaltime ) {
+		long mark = allocCount();
 		// Run the membership protocol
 		mp1Run();
+		long mp1Tick = allocCount() - mark, mp2Tick = 0;
 
 		// Wait for all nodes to join
 		if ( par->allNodesJoined == nodeCount && !allNodesJoined ) {
 			timeWhenAllNodesHaveJoined = par->getcurrtime();
 			allNodesJoined = true;
+			/*
+			 * Large groups are still joining at INSERT_TIME, and the KV store
+			 * pauses for 50 ticks after the last join. Push the whole test
+			 * schedule back so the inserts land 25 ticks into the resumed run.
+			 */
+			if ( par->SHIFT_TESTS ) {
+				testShift = max(0, timeWhenAllNodesHaveJoined + 75 - INSERT_TIME);
+			}
 		}
 		if ( par->getcurrtime() > timeWhenAllNodesHaveJoined + 50 ) {
 			// Call the KV store functionalities
 			mp2Run();
+			mp2Tick = allocCount() - mark - mp1Tick;
+			mp1Allocs += mp1Tick;
+			mp2Allocs += mp2Tick;
+			steadyTicks++;
 		}
+#ifdef ALLOCBENCH
+		if ( allocs ) {
+			fprintf(allocs, "%d mp1 %ld (%.2f/node) mp2 %ld (%.2f/node)\n", par->getcurrtime(),
+					mp1Tick, (double)mp1Tick / par->EN_GPSZ, mp2Tick, (double)mp2Tick / par->EN_GPSZ);
+		}
+#endif
 		// Fail some nodes
 		//fail();
 	}
+#ifdef ALLOCBENCH
+	if ( allocs ) {
+		for ( int layer = 0; layer < 2 && steadyTicks > 0; layer++ ) {
+			long n = layer ? mp2Allocs : mp1Allocs;
+			fprintf(allocs, "%s: %ld allocations in %ld ticks of the KV store, %.2f per tick, %.4f per tick per node\n",
+					layer ? "mp2" : "mp1", n, steadyTicks, (double)n / steadyTicks, (double)n / steadyTicks / par->EN_GPSZ);
+		}
+		fclose(allocs);
+	}
+#endif
 
 	// Clean up
+	FILE *stats = fopen("netstats.log", "w");
+	if ( stats ) {
+		en->ENreport(stats, "membership");
+		en1->ENreport(stats, "kvstore");
+		fclose(stats);
+	}
+	FILE *load = fopen("load.log", "w");
+	if ( load ) {
+		loadReport(load);
+		fclose(load);
+	}
 	en->ENcleanup();
 	en1->ENcleanup();
 
@@ -139,6 +217,11 @@ int Application::run()
 void Application::mp1Run() {
 	int i;
 
+	if ( pool ) {
+		mp1RunParallel();
+		return;
+	}
+
 	// For all the nodes in the system
 	for( i = 0; i <= par->EN_GPSZ-1; i++) {
 
@@ -181,6 +264,38 @@ void Application::mp1Run() {
 	}
 }
 
+/**
+ * FUNCTION NAME: mp1RunParallel
+ *
+ * DESCRIPTION:	Same as mp1Run with the per-node loops spread over the worker pool.
+ * 				Messages sent in a tick are only received in the next one, so the order
+ * 				in which nodes run within a phase does not matter
+ */
+void Application::mp1RunParallel() {
+	int i;
+
+	pool->parallelFor(par->EN_GPSZ, [this](int i) {
+		if( par->getcurrtime() > (int)(par->STEP_RATE*i) && !(mp1[i]->getMemberNode()->bFailed) ) {
+			mp1[i]->recvLoop();
+		}
+	});
+
+	// Introductions stay serial, they update the shared nodeCount
+	for( i = par->EN_GPSZ - 1; i >= 0; i-- ) {
+		if( par->getcurrtime() == (int)(par->STEP_RATE*i) ) {
+			mp1[i]->nodeStart(JOINADDR, par->PORTNUM);
+			cout<<i<<"-th introduced node is assigned with the address: "<<mp1[i]->getMemberNode()->addr.getAddress() << endl;
+			nodeCount += i;
+		}
+	}
+
+	pool->parallelFor(par->EN_GPSZ, [this](int i) {
+		if( par->getcurrtime() > (int)(par->STEP_RATE*i) && !(mp1[i]->getMemberNode()->bFailed) ) {
+			mp1[i]->nodeLoop();
+		}
+	});
+}
+
 /**
  * FUNCTION NAME: mp2Run
  *
@@ -221,22 +336,22 @@ void Application::mp2Run() {
 	/**
 	 * Insert a set of test key value pairs into the system
 	 */
-	if ( par->getcurrtime() == INSERT_TIME ) {
+	if ( testTime() == INSERT_TIME ) {
 		insertTestKVPairs();
 	}
 
 	/**
 	 * Test CRUD operations
 	 */
-	if ( par->getcurrtime() >= TEST_TIME ) {
+	if ( testTime() >= TEST_TIME ) {
 		/**************
 		 * CREATE TEST
 		 **************/
 		/**
-		 * TEST 1: Checks if there are RF * NUMBER_OF_INSERTS CREATE SUCCESS message are in the log
+		 * TEST 1: Checks if there are REPLICAS * NUMBER_OF_INSERTS CREATE SUCCESS message are in the log
 		 *
 		 */
-		if ( par->getcurrtime() == TEST_TIME && CREATE_TEST == par->CRUDTEST ) {
+		if ( testTime() == TEST_TIME && CREATE_TEST == par->CRUDTEST ) {
 			cout<<endl<<"Doing create test at time: "<<par->getcurrtime()<<endl;
 		} // End of create test
 
@@ -245,11 +360,11 @@ void Application::mp2Run() {
 		 ***************/
 		/**
 		 * TEST 1: NUMBER_OF_INSERTS/2 Key Value pair are deleted.
-		 * 		   Check whether RF * NUMBER_OF_INSERTS/2 DELETE SUCCESS message are in the log
+		 * 		   Check whether REPLICAS * NUMBER_OF_INSERTS/2 DELETE SUCCESS message are in the log
 		 * TEST 2: Delete a non-existent key. Check for a DELETE FAIL message in the lgo
 		 *
 		 */
-		else if ( par->getcurrtime() == TEST_TIME && DELETE_TEST == par->CRUDTEST ) {
+		else if ( testTime() == TEST_TIME && DELETE_TEST == par->CRUDTEST ) {
 			deleteTest();
 		} // End of delete test
 
@@ -284,7 +399,7 @@ void Application::mp2Run() {
 		 * TEST 5: Read a non-existent key. Check for a READ FAIL message in the log
 		 *
 		 */
-		else if ( par->getcurrtime() >= TEST_TIME && READ_TEST == par->CRUDTEST ) {
+		else if ( testTime() >= TEST_TIME && READ_TEST == par->CRUDTEST ) {
 			readTest();
 		} // end of read test
 
@@ -319,13 +434,46 @@ void Application::mp2Run() {
 		 * TEST 5: Update a non-existent key. Check for a UPDATE FAIL message in the log
 		 *
 		 */
-		else if ( par->getcurrtime() >= TEST_TIME && UPDATE_TEST == par->CRUDTEST ) {
+		else if ( testTime() >= TEST_TIME && UPDATE_TEST == par->CRUDTEST ) {
 			updateTest();
 		} // End of update test
 
 	} // end of if ( par->getcurrtime == TEST_TIME)
 }
 
+/**
+ * FUNCTION NAME: loadReport
+ *
+ * DESCRIPTION: Write the keys stored by every live node and the part of the ring it owns,
+ * 				then the mean and maximum of both over the live nodes
+ */
+void Application::loadReport(FILE *out) {
+	int live = 0;
+	unsigned long keys, totalKeys = 0, maxKeys = 0;
+	double share, totalShare = 0, maxShare = 0;
+
+	fprintf(out, "node keys ring_share (%d vnodes per node)\n", par->VNODES);
+	for ( int i = 0; i < par->EN_GPSZ; i++ ) {
+		if ( mp2[i]->getMemberNode()->bFailed ) {
+			continue;
+		}
+		keys = mp2[i]->keyCount();
+		share = mp2[i]->ownedShare();
+		fprintf(out, "%s %lu %.4f\n", mp2[i]->getMemberNode()->addr.getAddress().c_str(), keys, share);
+		live++;
+		totalKeys += keys;
+		totalShare += share;
+		maxKeys = max(maxKeys, keys);
+		maxShare = max(maxShare, share);
+	}
+	if ( 0 == live ) {
+		return;
+	}
+	double meanKeys = (double)totalKeys / live, meanShare = totalShare / live;
+	fprintf(out, "keys: mean %.2f max %lu max/mean %.2f\n", meanKeys, maxKeys, meanKeys > 0 ? maxKeys / meanKeys : 0);
+	fprintf(out, "ring share: mean %.4f max %.4f max/mean %.2f\n", meanShare, maxShare, meanShare > 0 ? maxShare / meanShare : 0);
+}
+
 /**
  * FUNCTION NAME: fail
  *
@@ -379,6 +527,19 @@ Address Application::getjoinaddr(void){
     return joinaddr;
 }
 
+/**
+ * FUNCTION NAME: testTime
+ *
+ * DESCRIPTION: Time on the test schedule, i.e. the global time less the shift
+ * 				run() applies for large groups. With SHIFT_TESTS, -1 until every node has joined
+ */
+int Application::testTime() {
+	if ( testShift < 0 ) {
+		return -1;
+	}
+	return par->getcurrtime() - testShift;
+}
+
 /**
  * FUNCTION NAME: findARandomNodeThatIsAlive
  *
@@ -392,13 +553,44 @@ int Application::findARandomNodeThatIsAlive() {
 	return number;
 }
 
+/**
+ * FUNCTION NAME: findANodeThatKnowsReplicasOf
+ *
+ * DESCRIPTION: Finds a random node that is alive and whose ring holds the replicas of key.
+ * 				With a partial view only the nodes near the key on the ring do
+ */
+int Application::findANodeThatKnowsReplicasOf(string key) {
+	int start = findARandomNodeThatIsAlive();
+	for ( int i = 0; i < par->EN_GPSZ; i++ ) {
+		int number = (start + i) % par->EN_GPSZ;
+		if ( !mp2[number]->getMemberNode()->bFailed && mp2[number]->knowsReplicasOf(key) ) {
+			return number;
+		}
+	}
+	return start;
+}
+
+/**
+ * FUNCTION NAME: isReplica
+ *
+ * DESCRIPTION: Whether node number is one of replicas
+ */
+bool Application::isReplica(vector<Node> &replicas, int number) {
+	for ( unsigned int i = 0; i < replicas.size(); i++ ) {
+		if ( mp2[number]->getMemberNode()->addr.getAddress() == replicas[i].getAddress()->getAddress() ) {
+			return true;
+		}
+	}
+	return false;
+}
+
 /**
  * FUNCTION NAME: initTestKVPairs
  *
  * DESCRIPTION: Init NUMBER_OF_INSERTS test KV pairs in the map
  */
 void Application::initTestKVPairs() {
-	srand(time(NULL));
+	srand(par->SEED);
 	int i;
 	string key;
 	key.clear();
@@ -487,14 +679,14 @@ void Application::readTest() {
 	map<string, string>::iterator it = testKVPairs.begin();
 	int number;
 	vector<Node> replicas;
-	int replicaIdToFail = TERTIARY;
+	int replicaIdToFail;
 	int nodeToFail;
 	bool failedOneNode = false;
 
 	/**
  	 * Test 1: Test if value of a single read operation is read correctly in quorum number of nodes
  	 */
-	if ( par->getcurrtime() == TEST_TIME ) {
+	if ( testTime() == TEST_TIME ) {
 		// Step 1.a. Find a node that is alive
 		number = findARandomNodeThatIsAlive();
 
@@ -509,21 +701,22 @@ void Application::readTest() {
 	/**
 	 * Test 2: FAIL ONE REPLICA. Test if value is read correctly in quorum number of nodes after ONE OF THE REPLICAS IS FAILED
 	 */
-	if ( par->getcurrtime() == (TEST_TIME + FIRST_FAIL_TIME) ) {
+	if ( testTime() == (TEST_TIME + FIRST_FAIL_TIME) ) {
 		// Step 2.a Find a node that is alive and assign it as number
-		number = findARandomNodeThatIsAlive();
+		number = findANodeThatKnowsReplicasOf(it->first);
 
 		// Step 2.b Find the replicas of this key
 		replicas.clear();
 		replicas = mp2[number]->findNodes(it->first);
 		// if less than quorum replicas are found then exit
-		if ( replicas.size() < (RF-1) ) {
+		if ( replicas.size() < (size_t)par->READ_QUORUM ) {
 			cout<<endl<<"Could not find at least quorum replicas for this key. Exiting!!! size of replicas vector: "<<replicas.size()<<endl;
 			log->LOG(&mp2[number]->getMemberNode()->addr, "Could not find at least quorum replicas for this key. Exiting!!! size of replicas vector: %d", replicas.size());
 			exit(1);
 		}
 
-		// Step 2.c Fail a replica
+		// Step 2.c Fail a replica, the last one first
+		replicaIdToFail = replicas.size() - 1;
 		for ( int i = 0; i < par->EN_GPSZ; i++ ) {
 			if ( mp2[i]->getMemberNode()->addr.getAddress() == replicas.at(replicaIdToFail).getAddress()->getAddress() ) {
 				if ( !mp2[i]->getMemberNode()->bFailed ) {
@@ -571,14 +764,14 @@ void Application::readTest() {
 	 * Test 3 part 1: Fail two replicas. Test if value is read correctly in quorum number of nodes after TWO OF THE REPLICAS ARE FAILED
 	 */
 	// Wait for STABILIZE_TIME and fail two replicas
-	if ( par->getcurrtime() >= (TEST_TIME + FIRST_FAIL_TIME + STABILIZE_TIME) ) {
+	if ( testTime() >= (TEST_TIME + FIRST_FAIL_TIME + STABILIZE_TIME) ) {
 		vector<int> nodesToFail;
 		nodesToFail.clear();
 		int count = 0;
 
-		if ( par->getcurrtime() == (TEST_TIME + FIRST_FAIL_TIME + STABILIZE_TIME) ) {
+		if ( testTime() == (TEST_TIME + FIRST_FAIL_TIME + STABILIZE_TIME) ) {
 			// Step 3.a. Find a node that is alive
-			number = findARandomNodeThatIsAlive();
+			number = findANodeThatKnowsReplicasOf(it->first);
 
 			// Get the keys replicas
 			replicas.clear();
@@ -586,9 +779,11 @@ void Application::readTest() {
 
 			// Step 3.b. Fail two replicas
 			//cout<<"REPLICAS SIZE: "<<replicas.size();
-			if ( replicas.size() > 2 ) {
-				replicaIdToFail = TERTIARY;
-				while ( count != 2 ) {
+			// Two of them, or the only one if REPLICAS is 1
+			int replicasToFail = min(2, par->REPLICAS);
+			if ( replicas.size() >= (size_t)par->REPLICAS ) {
+				replicaIdToFail = replicas.size() - 1;
+				while ( count != replicasToFail && replicaIdToFail >= 0 ) {
 					int i = 0;
 					while ( i != par->EN_GPSZ ) {
 						if ( mp2[i]->getMemberNode()->addr.getAddress() == replicas.at(replicaIdToFail).getAddress()->getAddress() ) {
@@ -600,9 +795,8 @@ void Application::readTest() {
 							}
 							else {
 								// Since we fail at most two nodes, one of the replicas must be alive
-								if ( replicaIdToFail > 0 ) {
-									replicaIdToFail--;
-								}
+								replicaIdToFail--;
+								break;
 							}
 						}
 						i++;
@@ -614,7 +808,7 @@ void Application::readTest() {
 				cout<<endl<<"Not enough replicas to fail two nodes. Number of replicas of this key: " <<replicas.size() <<". Exiting test case !! "<<endl;
 				exit(1);
 			}
-			if ( count == 2 ) {
+			if ( count == replicasToFail ) {
 				for ( int i = 0; i < nodesToFail.size(); i++ ) {
 					// Fail a node
 					log->LOG(&mp2[nodesToFail.at(i)]->getMemberNode()->addr, "Node failed at time=%d", par->getcurrtime());
@@ -644,7 +838,7 @@ void Application::readTest() {
 		 * TEST 3 part 2: After failing two replicas and waiting for STABILIZE_TIME, issue a read
 		 */
 		// Step 3.d Wait for stabilization protocol to kick in
-		if ( par->getcurrtime() == (TEST_TIME + FIRST_FAIL_TIME + STABILIZE_TIME + STABILIZE_TIME) ) {
+		if ( testTime() == (TEST_TIME + FIRST_FAIL_TIME + STABILIZE_TIME + STABILIZE_TIME) ) {
 			number = findARandomNodeThatIsAlive();
 			// Step 3.e Issue a read
 			cout<<endl<<"Reading a valid key.... ... .. . ."<<endl;
@@ -659,18 +853,16 @@ void Application::readTest() {
 	/**
 	 * Test 4: FAIL A NON-REPLICA. Test if value is read correctly in quorum number of nodes after a NON-REPLICA IS FAILED
 	 */
-	if ( par->getcurrtime() == (TEST_TIME + FIRST_FAIL_TIME + STABILIZE_TIME + STABILIZE_TIME + LAST_FAIL_TIME ) ) {
+	if ( testTime() == (TEST_TIME + FIRST_FAIL_TIME + STABILIZE_TIME + STABILIZE_TIME + LAST_FAIL_TIME ) ) {
 		// Step 4.a. Find a node that is alive
-		number = findARandomNodeThatIsAlive();
+		number = findANodeThatKnowsReplicasOf(it->first);
 
 		// Step 4.b Find a non - replica for this key
 		replicas.clear();
 		replicas = mp2[number]->findNodes(it->first);
 		for ( int i = 0; i < par->EN_GPSZ; i++ ) {
 			if ( !mp2[i]->getMemberNode()->bFailed ) {
-				if ( mp2[i]->getMemberNode()->addr.getAddress() != replicas.at(PRIMARY).getAddress()->getAddress() &&
-					 mp2[i]->getMemberNode()->addr.getAddress() != replicas.at(SECONDARY).getAddress()->getAddress() &&
-					 mp2[i]->getMemberNode()->addr.getAddress() != replicas.at(TERTIARY).getAddress()->getAddress() ) {
+				if ( !isReplica(replicas, i) ) {
 					// Step 4.c Fail a non-replica node
 					log->LOG(&mp2[i]->getMemberNode()->addr, "Node failed at time=%d", par->getcurrtime());
 					mp2[i]->getMemberNode()->bFailed = true;
@@ -702,7 +894,7 @@ void Application::readTest() {
 	/**
 	 * Test 5: Read a non-existent key.
 	 */
-	if ( par->getcurrtime() == (TEST_TIME + FIRST_FAIL_TIME + STABILIZE_TIME + STABILIZE_TIME + LAST_FAIL_TIME ) ) {
+	if ( testTime() == (TEST_TIME + FIRST_FAIL_TIME + STABILIZE_TIME + STABILIZE_TIME + LAST_FAIL_TIME ) ) {
 		string invalidKey = "invalidKey";
 
 		// Step 5.a Find a node that is alive
@@ -732,14 +924,14 @@ void Application::updateTest() {
 	string newValue = "newValue";
 	int number;
 	vector<Node> replicas;
-	int replicaIdToFail = TERTIARY;
+	int replicaIdToFail;
 	int nodeToFail;
 	bool failedOneNode = false;
 
 	/**
 	 * Test 1: Test if value is updated correctly in quorum number of nodes
 	 */
-	if ( par->getcurrtime() == TEST_TIME ) {
+	if ( testTime() == TEST_TIME ) {
 		// Step 1.a. Find a node that is alive
 		number = findARandomNodeThatIsAlive();
 
@@ -754,21 +946,22 @@ void Application::updateTest() {
 	/**
 	 * Test 2: FAIL ONE REPLICA. Test if value is updated correctly in quorum number of nodes after ONE OF THE REPLICAS IS FAILED
 	 */
-	if ( par->getcurrtime() == (TEST_TIME + FIRST_FAIL_TIME) ) {
+	if ( testTime() == (TEST_TIME + FIRST_FAIL_TIME) ) {
 		// Step 2.a Find a node that is alive and assign it as number
-		number = findARandomNodeThatIsAlive();
+		number = findANodeThatKnowsReplicasOf(it->first);
 
 		// Step 2.b Find the replicas of this key
 		replicas.clear();
 		replicas = mp2[number]->findNodes(it->first);
 		// if quorum replicas are not found then exit
-		if ( replicas.size() < RF-1 ) {
+		if ( replicas.size() < (size_t)par->WRITE_QUORUM ) {
 			log->LOG(&mp2[number]->getMemberNode()->addr, "Could not find at least quorum replicas for this key. Exiting!!! size of replicas vector: %d", replicas.size());
 			cout<<endl<<"Could not find at least quorum replicas for this key. Exiting!!! size of replicas vector: "<<replicas.size()<<endl;
 			exit(1);
 		}
 
-		// Step 2.c Fail a replica
+		// Step 2.c Fail a replica, the last one first
+		replicaIdToFail = replicas.size() - 1;
 		for ( int i = 0; i < par->EN_GPSZ; i++ ) {
 			if ( mp2[i]->getMemberNode()->addr.getAddress() == replicas.at(replicaIdToFail).getAddress()->getAddress() ) {
 				if ( !mp2[i]->getMemberNode()->bFailed ) {
@@ -815,24 +1008,26 @@ void Application::updateTest() {
 	/**
 	 * Test 3 part 1: Fail two replicas. Test if value is updated correctly in quorum number of nodes after TWO OF THE REPLICAS ARE FAILED
 	 */
-	if ( par->getcurrtime() >= (TEST_TIME + FIRST_FAIL_TIME + STABILIZE_TIME) ) {
+	if ( testTime() >= (TEST_TIME + FIRST_FAIL_TIME + STABILIZE_TIME) ) {
 
 		vector<int> nodesToFail;
 		nodesToFail.clear();
 		int count = 0;
 
-		if ( par->getcurrtime() == (TEST_TIME + FIRST_FAIL_TIME + STABILIZE_TIME) ) {
+		if ( testTime() == (TEST_TIME + FIRST_FAIL_TIME + STABILIZE_TIME) ) {
 			// Step 3.a. Find a node that is alive
-			number = findARandomNodeThatIsAlive();
+			number = findANodeThatKnowsReplicasOf(it->first);
 
 			// Get the keys replicas
 			replicas.clear();
 			replicas = mp2[number]->findNodes(it->first);
 
 			// Step 3.b. Fail two replicas
-			if ( replicas.size() > 2 ) {
-				replicaIdToFail = TERTIARY;
-				while ( count != 2 ) {
+			// Two of them, or the only one if REPLICAS is 1
+			int replicasToFail = min(2, par->REPLICAS);
+			if ( replicas.size() >= (size_t)par->REPLICAS ) {
+				replicaIdToFail = replicas.size() - 1;
+				while ( count != replicasToFail && replicaIdToFail >= 0 ) {
 					int i = 0;
 					while ( i != par->EN_GPSZ ) {
 						if ( mp2[i]->getMemberNode()->addr.getAddress() == replicas.at(replicaIdToFail).getAddress()->getAddress() ) {
@@ -844,9 +1039,8 @@ void Application::updateTest() {
 							}
 							else {
 								// Since we fail at most two nodes, one of the replicas must be alive
-								if ( replicaIdToFail > 0 ) {
-									replicaIdToFail--;
-								}
+								replicaIdToFail--;
+								break;
 							}
 						}
 						i++;
@@ -857,7 +1051,7 @@ void Application::updateTest() {
 				// If the code reaches here. Test your stabilization protocol
 				cout<<endl<<"Not enough replicas to fail two nodes. Exiting test case !! "<<endl;
 			}
-			if ( count == 2 ) {
+			if ( count == replicasToFail ) {
 				for ( int i = 0; i < nodesToFail.size(); i++ ) {
 					// Fail a node
 					log->LOG(&mp2[nodesToFail.at(i)]->getMemberNode()->addr, "Node failed at time=%d", par->getcurrtime());
@@ -886,7 +1080,7 @@ void Application::updateTest() {
 		 * TEST 3 part 2: After failing two replicas and waiting for STABILIZE_TIME, issue an update
 		 */
 		// Step 3.d Wait for stabilization protocol to kick in
-		if ( par->getcurrtime() == (TEST_TIME + FIRST_FAIL_TIME + STABILIZE_TIME + STABILIZE_TIME) ) {
+		if ( testTime() == (TEST_TIME + FIRST_FAIL_TIME + STABILIZE_TIME + STABILIZE_TIME) ) {
 			number = findARandomNodeThatIsAlive();
 			// Step 3.e Issue a update
 			cout<<endl<<"Updating a valid key.... ... .. . ."<<endl;
@@ -901,18 +1095,16 @@ void Application::updateTest() {
 	/**
 	 * Test 4: FAIL A NON-REPLICA. Test if value is read correctly in quorum number of nodes after a NON-REPLICA IS FAILED
 	 */
-	if ( par->getcurrtime() == (TEST_TIME + FIRST_FAIL_TIME + STABILIZE_TIME + STABILIZE_TIME + LAST_FAIL_TIME ) ) {
+	if ( testTime() == (TEST_TIME + FIRST_FAIL_TIME + STABILIZE_TIME + STABILIZE_TIME + LAST_FAIL_TIME ) ) {
 		// Step 4.a. Find a node that is alive
-		number = findARandomNodeThatIsAlive();
+		number = findANodeThatKnowsReplicasOf(it->first);
 
 		// Step 4.b Find a non - replica for this key
 		replicas.clear();
 		replicas = mp2[number]->findNodes(it->first);
 		for ( int i = 0; i < par->EN_GPSZ; i++ ) {
 			if ( !mp2[i]->getMemberNode()->bFailed ) {
-				if ( mp2[i]->getMemberNode()->addr.getAddress() != replicas.at(PRIMARY).getAddress()->getAddress() &&
-					 mp2[i]->getMemberNode()->addr.getAddress() != replicas.at(SECONDARY).getAddress()->getAddress() &&
-					 mp2[i]->getMemberNode()->addr.getAddress() != replicas.at(TERTIARY).getAddress()->getAddress() ) {
+				if ( !isReplica(replicas, i) ) {
 					// Step 4.c Fail a non-replica node
 					log->LOG(&mp2[i]->getMemberNode()->addr, "Node failed at time=%d", par->getcurrtime());
 					mp2[i]->getMemberNode()->bFailed = true;
@@ -945,7 +1137,7 @@ void Application::updateTest() {
 	/**
 	 * Test 5: Udpate a non-existent key.
 	 */
-	if ( par->getcurrtime() == (TEST_TIME + FIRST_FAIL_TIME + STABILIZE_TIME + STABILIZE_TIME + LAST_FAIL_TIME ) ) {
+	if ( testTime() == (TEST_TIME + FIRST_FAIL_TIME + STABILIZE_TIME + STABILIZE_TIME + LAST_FAIL_TIME ) ) {
 		string invalidKey = "invalidKey";
 		string invalidValue = "invalidValue";
 
@@ -13,6 +13,10 @@
 #include "Params.h"
 #include "Member.h"
 #include "EmulNet.h"
+#include "UdpNet.h"
+#include "ShmNet.h"
+#include "WorkerPool.h"
+#include "AllocCount.h"
 #include "Queue.h"
 #include "MP2Node.h"
 #include "Node.h"
@@ -37,7 +41,6 @@ static const char alphanum[] =
 #define STABILIZE_TIME 50
 #define FIRST_FAIL_TIME 25
 #define LAST_FAIL_TIME 10
-#define RF 3
 #define NUMBER_OF_INSERTS 100
 #define KEY_LENGTH 5
 
@@ -57,7 +60,11 @@ private:
 	MP1Node **mp1;
 	MP2Node **mp2;
 	Params *par;
+	// Runs the per-node membership loops in parallel, NULL when serial
+	WorkerPool *pool;
 	map<string, string> testKVPairs;
+	// Ticks the test schedule is pushed back by, -1 until every node has joined with SHIFT_TESTS
+	int testShift;
 public:
 	Application(char *);
 	virtual ~Application();
@@ -65,10 +72,15 @@ public:
 	void initTestKVPairs();
 	int run();
 	void mp1Run();
+	void mp1RunParallel();
 	void mp2Run();
 	void fail();
+	void loadReport(FILE *out);
 	void insertTestKVPairs();
+	int testTime();
 	int findARandomNodeThatIsAlive();
+	int findANodeThatKnowsReplicasOf(string key);
+	bool isReplica(vector<Node> &replicas, int number);
 	void deleteTest();
 	void readTest();
 	void updateTest();
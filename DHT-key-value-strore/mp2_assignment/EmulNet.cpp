@@ -12,53 +12,27 @@
 EmulNet::EmulNet(Params *p)
 {
 	//trace.funcEntry("EmulNet::EmulNet");
-	int i,j;
 	par = p;
 	emulnet.setNextId(1);
 	emulnet.settCurrBuffSize(0);
 	enInited=0;
-	for ( i = 0; i < MAX_NODES; i++ ) {
-		for ( j = 0; j < MAX_TIME; j++ ) {
-			sent_msgs[i][j] = 0;
-			recv_msgs[i][j] = 0;
-		}
+	boxes = NULL;
+	nboxes = 0;
+	traceFile = NULL;
+	replaying = false;
+	diverged = false;
+	traceEvents = 0;
+	// Several threads drive the nodes: every mailbox and counter row exists before they start
+	concurrent = par->THREADS > 1;
+	if ( concurrent ) {
+		nboxes = par->EN_GPSZ + 1;
+		boxes = new mpsc_box[nboxes];
+		sent_msgs.reserveNodes(nboxes);
+		recv_msgs.reserveNodes(nboxes);
 	}
 	//trace.funcExit("EmulNet::EmulNet", SUCCESS);
 }
 
-/**
- * Copy constructor
- */
-EmulNet::EmulNet(EmulNet &anotherEmulNet) {
-	int i, j;
-	this->par = anotherEmulNet.par;
-	this->enInited = anotherEmulNet.enInited;
-	for ( i = 0; i < MAX_NODES; i++ ) {
-		for ( j = 0; j < MAX_TIME; j++ ) {
-			this->sent_msgs[i][j] = anotherEmulNet.sent_msgs[i][j];
-			this->recv_msgs[i][j] = anotherEmulNet.recv_msgs[i][j];
-		}
-	}
-	this->emulnet = anotherEmulNet.emulnet;
-}
-
-/**
- * Assignment operator overloading
- */
-EmulNet& EmulNet::operator =(EmulNet &anotherEmulNet) {
-	int i, j;
-	this->par = anotherEmulNet.par;
-	this->enInited = anotherEmulNet.enInited;
-	for ( i = 0; i < MAX_NODES; i++ ) {
-		for ( j = 0; j < MAX_TIME; j++ ) {
-			this->sent_msgs[i][j] = anotherEmulNet.sent_msgs[i][j];
-			this->recv_msgs[i][j] = anotherEmulNet.recv_msgs[i][j];
-		}
-	}
-	this->emulnet = anotherEmulNet.emulnet;
-	return *this;
-}
-
 /**
  * Destructor
  */
@@ -73,6 +47,10 @@ void *EmulNet::ENinit(Address *myaddr, short port) {
 	// Initialize data structures for this member
 	*(int *)(myaddr->addr) = emulnet.nextid++;
     *(short *)(&myaddr->addr[4]) = 0;
+	// Sized here, while nodes are still created one at a time
+	if ( emulnet.nextid > (int)counters.size() ) {
+		counters.resize(emulnet.nextid);
+	}
 	return myaddr;
 }
 
@@ -85,38 +63,301 @@ void *EmulNet::ENinit(Address *myaddr, short port) {
  * size
  */
 int EmulNet::ENsend(Address *myaddr, Address *toaddr, char *data, int size) {
+	return sendFrame(myaddr, toaddr, data, size, 0);
+}
+
+/**
+ * FUNCTION NAME: ENsendv
+ *
+ * DESCRIPTION: Send several messages to one destination, packed into as few frames as
+ * 				MAX_MSG_SIZE allows. Each frame is delivered or dropped as a whole, the
+ * 				receiver gets the messages back one by one. The messages of frames the network
+ * 				refused are appended to unsent, when given, for the caller to try again
+ *
+ * RETURNS:
+ * Number of messages sent
+ */
+int EmulNet::ENsendv(Address *myaddr, Address *toaddr, const vector<string> &msgs, vector<string> *unsent) {
+	static thread_local vector<char> buf;
+	// Index in msgs of every message packed in buf
+	static thread_local vector<unsigned int> packed;
+	int limit = par->MAX_MSG_SIZE - (int)sizeof(en_msg);
+	int parts = 0, sent = 0, len, rec;
+
+	buf.clear();
+	packed.clear();
+	for ( unsigned int i = 0; i < msgs.size(); i++ ) {
+		len = msgs[i].length();
+		// Length, then the bytes, padded so the next length stays aligned
+		rec = (sizeof(int) + len + sizeof(int) - 1) & ~(sizeof(int) - 1);
+
+		if ( parts > 0 && (int)buf.size() + rec >= limit ) {
+			sent += packedSend(myaddr, toaddr, buf, packed, msgs, unsent);
+			parts = 0;
+		}
+		// Too big for any frame, refused and counted like a plain send would be
+		if ( rec >= limit ) {
+			countersOf(myaddr).oversized++;
+			continue;
+		}
+
+		buf.resize(buf.size() + rec);
+		char *p = &buf[buf.size() - rec];
+		memcpy(p, &len, sizeof(int));
+		memcpy(p + sizeof(int), msgs[i].data(), len);
+		packed.push_back(i);
+		parts++;
+	}
+	if ( parts > 0 ) {
+		sent += packedSend(myaddr, toaddr, buf, packed, msgs, unsent);
+	}
+
+	return sent;
+}
+
+/**
+ * FUNCTION NAME: packedSend
+ *
+ * DESCRIPTION: Send the messages packed in buf as one frame and empty buf. If the frame is
+ * 				refused the messages of msgs it packed go to unsent
+ *
+ * RETURNS:
+ * Number of messages sent
+ */
+int EmulNet::packedSend(Address *myaddr, Address *toaddr, vector<char> &buf, vector<unsigned int> &packed,
+		const vector<string> &msgs, vector<string> *unsent) {
+	int parts = packed.size();
+	int sent = sendFrame(myaddr, toaddr, buf.data(), buf.size(), parts) > 0 ? parts : 0;
+	if ( 0 == sent && unsent ) {
+		for ( unsigned int i = 0; i < packed.size(); i++ ) {
+			unsent->push_back(msgs[packed[i]]);
+		}
+	}
+	buf.clear();
+	packed.clear();
+	return sent;
+}
+
+/**
+ * FUNCTION NAME: sendFrame
+ *
+ * DESCRIPTION: Put one frame on the network, carrying parts packed messages or, when parts is 0, a plain payload
+ *
+ * RETURNS:
+ * size
+ */
+int EmulNet::sendFrame(Address *myaddr, Address *toaddr, char *data, int size, int parts) {
 	en_msg *em;
-	static char temp[2048];
-	int sendmsg = rand() % 100;
+	int sendmsg = dropRoll(myaddr);
+	bool oversized = size + (int)sizeof(en_msg) >= par->MAX_MSG_SIZE;
+	bool dropped = par->dropmsg && sendmsg < (int) (par->MSG_DROP_PROB * 100);
+	en_counters &stats = countersOf(myaddr);
+
+	if ( concurrent ) {
+		if ( oversized ) {
+			stats.oversized++;
+			return 0;
+		}
+		if ( dropped ) {
+			stats.dropped++;
+			return 0;
+		}
+		return sendConcurrent(myaddr, toaddr, data, size, parts);
+	}
 
-	if( (emulnet.currbuffsize >= ENBUFFSIZE) || (size + (int)sizeof(en_msg) >= par->MAX_MSG_SIZE) || (par->dropmsg && sendmsg < (int) (par->MSG_DROP_PROB * 100)) ) {
+	mailbox &box = emulnet.inbox[EM::key(toaddr)];
+	int verdict = TRACE_SENT;
+	if( oversized || box.queued >= par->QUEUE_LIMIT ) {
+		verdict = TRACE_REFUSED;
+	}
+	else if ( dropped ) {
+		verdict = TRACE_DROPPED;
+	}
+	if ( traceFile ) {
+		verdict = traceSend(myaddr, toaddr, data, size, verdict);
+	}
+	if ( TRACE_REFUSED == verdict ) {
+		if ( oversized ) {
+			stats.oversized++;
+		}
+		else {
+			stats.overflowed++;
+		}
 		return 0;
 	}
+	if ( TRACE_DROPPED == verdict ) {
+		stats.dropped++;
+		return 0;
+	}
+
+	int src = *(int *)(myaddr->addr);
+	int time = par->getcurrtime();
+	int due = arrivalTime(myaddr, toaddr, sizeof(en_msg) + size);
 
-	em = (en_msg *)malloc(sizeof(en_msg) + size);
+	if ( due > time ) {
+		// Still on the wire, parked in the timer wheel until it is due
+		em = (en_msg *)malloc(sizeof(en_msg) + size);
+	}
+	else {
+		em = allocFrame(box, sizeof(en_msg) + size);
+	}
 	em->size = size;
+	em->parts = parts;
 
 	memcpy(&(em->from.addr), &(myaddr->addr), sizeof(em->from.addr));
 	memcpy(&(em->to.addr), &(toaddr->addr), sizeof(em->from.addr));
 	memcpy(em + 1, data, size);
 
-	emulnet.buff[emulnet.currbuffsize++] = em;
+	if ( due > time ) {
+		wheel.schedule(due, em);
+	}
+	else {
+		box.msgs.push_back(em);
+	}
+	box.queued++;
+	emulnet.currbuffsize++;
 
-	int src = *(int *)(myaddr->addr);
-	int time = par->getcurrtime();
+	stats.sent++;
+	stats.bytes += size;
+	sent_msgs.inc(src, time);
 
-	assert(src <= MAX_NODES);
-	assert(time < MAX_TIME);
+	return size;
+}
 
-	sent_msgs[src][time]++;
+/**
+ * FUNCTION NAME: sendConcurrent
+ *
+ * DESCRIPTION: Push a frame onto the lock-free mailbox of toaddr. Safe to call from any thread,
+ * 				as long as each node is driven by one thread at a time. The link model does not apply
+ *
+ * RETURNS:
+ * size
+ */
+int EmulNet::sendConcurrent(Address *myaddr, Address *toaddr, char *data, int size, int parts) {
+	int dst = *(int *)(toaddr->addr);
+
+	if ( dst < 0 || dst >= nboxes ) {
+		return 0;
+	}
+	mpsc_box &box = boxes[dst];
+	if ( box.queued.load(memory_order_relaxed) >= par->QUEUE_LIMIT ) {
+		countersOf(myaddr).overflowed++;
+		return 0;
+	}
+
+	en_frame *f = (en_frame *)malloc(sizeof(en_frame) + size);
+	f->msg.size = size;
+	f->msg.parts = parts;
+	memcpy(&(f->msg.from.addr), &(myaddr->addr), sizeof(f->msg.from.addr));
+	memcpy(&(f->msg.to.addr), &(toaddr->addr), sizeof(f->msg.to.addr));
+	memcpy(&f->msg + 1, data, size);
+
+	box.queued.fetch_add(1, memory_order_relaxed);
+	f->next = box.head.load(memory_order_relaxed);
+	while ( !box.head.compare_exchange_weak(f->next, f, memory_order_release, memory_order_relaxed) );
 
-	#ifdef DEBUGLOG
-		sprintf(temp, "Sending 4+%d B msg type %d to %d.%d.%d.%d:%d ", size-4, *(int *)data, toaddr->addr[0], toaddr->addr[1], toaddr->addr[2], toaddr->addr[3], *(short *)&toaddr->addr[4]);
-	#endif
+	countersOf(myaddr).sent++;
+	countersOf(myaddr).bytes += size;
+	sent_msgs.inc(*(int *)(myaddr->addr), par->getcurrtime());
 
 	return size;
 }
 
+/**
+ * FUNCTION NAME: countersOf
+ *
+ * DESCRIPTION: Send counters of the node with this address
+ */
+en_counters &EmulNet::countersOf(Address *addr) {
+	int id = *(int *)(addr->addr);
+	if ( id < 0 ) {
+		id = 0;
+	}
+	if ( id >= (int)counters.size() ) {
+		counters.resize(id + 1);
+	}
+	return counters[id];
+}
+
+/**
+ * FUNCTION NAME: ENpressure
+ *
+ * DESCRIPTION: How full the queue of frames bound for toaddr is. Senders use it to hold back
+ * 				traffic that can wait. The UDP and shared memory transports do not queue frames
+ * 				here and always report EN_CLEAR
+ */
+en_pressure EmulNet::ENpressure(Address *toaddr) {
+	int queued = 0;
+
+	if ( concurrent ) {
+		int dst = *(int *)(toaddr->addr);
+		if ( dst >= 0 && dst < nboxes ) {
+			queued = boxes[dst].queued.load(memory_order_relaxed);
+		}
+	}
+	else {
+		unordered_map<unsigned long long, mailbox>::iterator it = emulnet.inbox.find(EM::key(toaddr));
+		if ( it != emulnet.inbox.end() ) {
+			queued = it->second.queued;
+		}
+	}
+
+	if ( queued >= par->QUEUE_LIMIT ) {
+		return EN_FULL;
+	}
+	if ( 4 * queued >= 3 * par->QUEUE_LIMIT ) {
+		return EN_CONGESTED;
+	}
+	return EN_CLEAR;
+}
+
+/**
+ * FUNCTION NAME: ENreport
+ *
+ * DESCRIPTION: Write the send counters of every node, and their totals
+ */
+void EmulNet::ENreport(FILE *file, const char *name) {
+	en_counters total;
+
+	fprintf(file, "%s network\n", name);
+	for ( unsigned int i = 1; i < counters.size(); i++ ) {
+		en_counters &c = counters[i];
+		fprintf(file, "node %3u sent %7ld bytes %9ld dropped %6ld overflowed %6ld oversized %6ld\n", i, c.sent, c.bytes, c.dropped, c.overflowed, c.oversized);
+		total.sent += c.sent;
+		total.bytes += c.bytes;
+		total.dropped += c.dropped;
+		total.overflowed += c.overflowed;
+		total.oversized += c.oversized;
+	}
+	fprintf(file, "total    sent %7ld bytes %9ld dropped %6ld overflowed %6ld oversized %6ld\n\n", total.sent, total.bytes, total.dropped, total.overflowed, total.oversized);
+}
+
+/**
+ * FUNCTION NAME: dropRoll
+ *
+ * DESCRIPTION: Number in [0, 100) for the drop decision of a frame myaddr sends. Every node has its
+ * 				own generator, seeded from SEED and its id, so the decisions do not depend on which
+ * 				thread runs the node
+ */
+int EmulNet::dropRoll(Address *myaddr) {
+	unsigned int &state = countersOf(myaddr).dropState;
+	if ( 0 == state ) {
+		// Mixed so that neighbouring ids start far apart
+		unsigned int seed = par->SEED + 0x9E3779B9u * (unsigned int)(*(int *)(myaddr->addr) + 1);
+		seed ^= seed >> 16;
+		seed *= 0x85EBCA6Bu;
+		seed ^= seed >> 13;
+		seed *= 0xC2B2AE35u;
+		seed ^= seed >> 16;
+		state = seed | 1;
+	}
+	// xorshift32
+	state ^= state << 13;
+	state ^= state >> 17;
+	state ^= state << 5;
+	return state % 100;
+}
+
 /**
  * FUNCTION NAME: ENsend
  *
@@ -125,57 +366,249 @@ int EmulNet::ENsend(Address *myaddr, Address *toaddr, char *data, int size) {
  * RETURNS:
  * size
  */
-int EmulNet::ENsend(Address *myaddr, Address *toaddr, string data) {
-	char * str = (char *) malloc(data.length() * sizeof(char));
-	memcpy(str, data.c_str(), data.size());
-	int ret = this->ENsend(myaddr, toaddr, str, (data.length() * sizeof(char)));
-	free(str);
-	return ret;
+int EmulNet::ENsend(Address *myaddr, Address *toaddr, const string &data) {
+	return this->ENsend(myaddr, toaddr, (char *)data.data(), (data.length() * sizeof(char)));
+}
+
+/**
+ * FUNCTION NAME: arrivalTime
+ *
+ * DESCRIPTION: Time unit at which a frame sent now reaches toaddr: propagation delay and jitter,
+ * 				extra delay on links touching a slow node, and queueing behind earlier frames
+ * 				when the link bandwidth is limited
+ */
+int EmulNet::arrivalTime(Address *myaddr, Address *toaddr, int frameSize) {
+	int now = par->getcurrtime();
+	double delay = par->LINK_DELAY;
+
+	if ( par->LINK_JITTER > 0 ) {
+		delay += rand() % (par->LINK_JITTER + 1);
+	}
+
+	if ( par->SLOW_NODE_DELAY > 0 ) {
+		int from = *(int *)(myaddr->addr);
+		int to = *(int *)(toaddr->addr);
+		if ( find(par->SLOW_NODES.begin(), par->SLOW_NODES.end(), from) != par->SLOW_NODES.end() ||
+			 find(par->SLOW_NODES.begin(), par->SLOW_NODES.end(), to) != par->SLOW_NODES.end() ) {
+			delay += par->SLOW_NODE_DELAY;
+		}
+	}
+
+	if ( par->LINK_BANDWIDTH > 0 ) {
+		double &freeAt = linkFreeAt[make_pair(EM::key(myaddr), EM::key(toaddr))];
+		freeAt = max(freeAt, (double)now) + (double)frameSize / par->LINK_BANDWIDTH;
+		delay += freeAt - now;
+	}
+
+	return now + (int)delay;
+}
+
+/**
+ * FUNCTION NAME: advanceWheel
+ *
+ * DESCRIPTION: Move the timer wheel up to the current time, copying every frame that
+ * 				became due into the mailbox of its destination
+ */
+void EmulNet::advanceWheel() {
+	vector<en_msg *> expired;
+
+	while ( wheel.now < par->getcurrtime() ) {
+		wheel.tick(expired);
+	}
+
+	for ( unsigned int i = 0; i < expired.size(); i++ ) {
+		en_msg *emsg = expired[i];
+		mailbox &box = emulnet.inbox[EM::key(&emsg->to)];
+		en_msg *em = allocFrame(box, sizeof(en_msg) + emsg->size);
+		memcpy(em, emsg, sizeof(en_msg) + emsg->size);
+		box.msgs.push_back(em);
+		free(emsg);
+	}
+}
+
+/**
+ * FUNCTION NAME: allocFrame
+ *
+ * DESCRIPTION: Bump allocate a frame in the pending slab of the destination mailbox,
+ * 				starting a new slab when the current one is full
+ */
+en_msg *EmulNet::allocFrame(mailbox &box, int frameSize) {
+	char *slab;
+
+	frameSize = (frameSize + ENFRAMEALIGN - 1) & ~(ENFRAMEALIGN - 1);
+	assert(frameSize <= ENSLABSIZE);
+
+	if ( box.slabUsed + frameSize > ENSLABSIZE ) {
+		if ( emulnet.freeSlabs.empty() ) {
+			slab = (char *) malloc(ENSLABSIZE);
+		}
+		else {
+			slab = emulnet.freeSlabs.back();
+			emulnet.freeSlabs.pop_back();
+		}
+		box.pendingSlabs.push_back(slab);
+		box.slabUsed = 0;
+	}
+
+	slab = box.pendingSlabs.back() + box.slabUsed;
+	box.slabUsed += frameSize;
+	return (en_msg *)slab;
 }
 
 /**
  * FUNCTION NAME: ENrecv
  *
  * DESCRIPTION: EmulNet receive function
+ * 				Only the mailbox of myaddr is visited, messages are delivered in the order they were sent.
+ * 				The buffers handed to enq point into the frames themselves and stay valid until
+ * 				the receiver calls ENrelease
  *
  * RETURN:
  * 0
  */
 int EmulNet::ENrecv(Address *myaddr, int (* enq)(void *, char *, int), struct timeval *t, int times, void *queue){
 	// times is always assumed to be 1
-	int i;
-	char* tmp;
-	int sz;
+	unsigned int i;
 	en_msg *emsg;
 
-	for( i = emulnet.currbuffsize - 1; i >= 0; i-- ) {
-		emsg = emulnet.buff[i];
+	if ( concurrent ) {
+		return recvConcurrent(myaddr, enq, queue);
+	}
+
+	advanceWheel();
+
+	unordered_map<unsigned long long, mailbox>::iterator it = emulnet.inbox.find(EM::key(myaddr));
+	if ( it == emulnet.inbox.end() || it->second.msgs.empty() ) {
+		return 0;
+	}
+	mailbox &box = it->second;
+	vector<en_msg *> &msgs = box.msgs;
+
+	int dst = *(int *)(myaddr->addr);
+	int time = par->getcurrtime();
 
-		if ( 0 == strcmp(emsg->to.addr, myaddr->addr) ) {
-			sz = emsg->size;
-			tmp = (char *) malloc(sz * sizeof(char));
-			memcpy(tmp, (char *)(emsg+1), sz);
+	for( i = 0; i < msgs.size(); i++ ) {
+		emsg = msgs[i];
 
-			emulnet.buff[i] = emulnet.buff[emulnet.currbuffsize-1];
-			emulnet.currbuffsize--;
+		if ( traceFile ) {
+			traceDeliver(emsg);
+		}
+		deliverFrame(emsg, enq, queue);
 
-			(*enq)(queue, (char *)tmp, sz);
+		recv_msgs.inc(dst, time);
+	}
 
-			free(emsg);
+	emulnet.currbuffsize -= msgs.size();
+	box.queued -= msgs.size();
+	// Keep the capacity around, the mailbox is refilled every tick
+	msgs.clear();
 
-			int dst = *(int *)(myaddr->addr);
-			int time = par->getcurrtime();
+	// Frames sent from now on go to fresh slabs
+	box.deliveredSlabs.insert(box.deliveredSlabs.end(), box.pendingSlabs.begin(), box.pendingSlabs.end());
+	box.pendingSlabs.clear();
+	box.slabUsed = ENSLABSIZE;
 
-			assert(dst <= MAX_NODES);
-			assert(time < MAX_TIME);
+	return 0;
+}
+
+/**
+ * FUNCTION NAME: deliverFrame
+ *
+ * DESCRIPTION: Hand the messages of a frame to enq, unpacking what ENsendv packed
+ *
+ * RETURN:
+ * Number of messages delivered
+ */
+int EmulNet::deliverFrame(en_msg *em, int (* enq)(void *, char *, int), void *queue) {
+	char *p = (char *)(em + 1);
+	char *end = p + em->size;
+	int len, k;
+
+	if ( 0 == em->parts ) {
+		(*enq)(queue, p, em->size);
+		return 1;
+	}
 
-			recv_msgs[dst][time]++;
+	for ( k = 0; k < em->parts && p + (int)sizeof(int) <= end; k++ ) {
+		memcpy(&len, p, sizeof(int));
+		p += sizeof(int);
+		if ( len < 0 || len > end - p ) {
+			break;
 		}
+		(*enq)(queue, p, len);
+		p += (len + sizeof(int) - 1) & ~(sizeof(int) - 1);
+	}
+	return k;
+}
+
+/**
+ * FUNCTION NAME: recvConcurrent
+ *
+ * DESCRIPTION: Take every frame pushed onto the mailbox of myaddr so far and deliver them in send order
+ *
+ * RETURN:
+ * 0
+ */
+int EmulNet::recvConcurrent(Address *myaddr, int (* enq)(void *, char *, int), void *queue) {
+	int dst = *(int *)(myaddr->addr);
+	int time = par->getcurrtime();
+	int n = 0;
+	en_frame *f, *next, *prev = NULL;
+
+	if ( dst < 0 || dst >= nboxes ) {
+		return 0;
+	}
+	mpsc_box &box = boxes[dst];
+
+	// Producers push at the head, reverse the list to get the send order
+	f = box.head.exchange(NULL, memory_order_acquire);
+	while ( f ) {
+		next = f->next;
+		f->next = prev;
+		prev = f;
+		f = next;
 	}
 
+	for ( f = prev; f; f = f->next ) {
+		deliverFrame(&f->msg, enq, queue);
+		box.delivered.push_back(f);
+		recv_msgs.inc(dst, time);
+		n++;
+	}
+	box.queued.fetch_sub(n, memory_order_relaxed);
+
 	return 0;
 }
 
+/**
+ * FUNCTION NAME: ENrelease
+ *
+ * DESCRIPTION: Hand the slabs of every frame delivered to myaddr back to the EmulNet.
+ * 				Called once the receiver has consumed its queue; the buffers it got
+ * 				from ENrecv are invalid afterwards
+ */
+void EmulNet::ENrelease(Address *myaddr) {
+	if ( concurrent ) {
+		int dst = *(int *)(myaddr->addr);
+		if ( dst >= 0 && dst < nboxes ) {
+			vector<en_frame *> &frames = boxes[dst].delivered;
+			for ( unsigned int k = 0; k < frames.size(); k++ ) {
+				free(frames[k]);
+			}
+			frames.clear();
+		}
+		return;
+	}
+
+	unordered_map<unsigned long long, mailbox>::iterator it = emulnet.inbox.find(EM::key(myaddr));
+	if ( it == emulnet.inbox.end() ) {
+		return;
+	}
+	vector<char *> &slabs = it->second.deliveredSlabs;
+	emulnet.freeSlabs.insert(emulnet.freeSlabs.end(), slabs.begin(), slabs.end());
+	slabs.clear();
+}
+
 /**
  * FUNCTION NAME: ENcleanup
  *
@@ -188,9 +621,37 @@ int EmulNet::ENcleanup() {
 
 	FILE* file = fopen("msgcount.log", "w+");
 
-	while(emulnet.currbuffsize > 0) {
-		free(emulnet.buff[--emulnet.currbuffsize]);
+	unordered_map<unsigned long long, mailbox>::iterator box;
+	for ( box = emulnet.inbox.begin(); box != emulnet.inbox.end(); box++ ) {
+		for ( unsigned int k = 0; k < box->second.pendingSlabs.size(); k++ ) {
+			free(box->second.pendingSlabs[k]);
+		}
+		for ( unsigned int k = 0; k < box->second.deliveredSlabs.size(); k++ ) {
+			free(box->second.deliveredSlabs[k]);
+		}
+	}
+	while ( !emulnet.freeSlabs.empty() ) {
+		free(emulnet.freeSlabs.back());
+		emulnet.freeSlabs.pop_back();
 	}
+	emulnet.inbox.clear();
+	emulnet.currbuffsize = 0;
+	wheel.clear();
+
+	for ( i = 0; i < nboxes; i++ ) {
+		en_frame *f = boxes[i].head.exchange(NULL);
+		while ( f ) {
+			en_frame *next = f->next;
+			free(f);
+			f = next;
+		}
+		for ( j = 0; j < (int)boxes[i].delivered.size(); j++ ) {
+			free(boxes[i].delivered[j]);
+		}
+	}
+	delete [] boxes;
+	boxes = NULL;
+	nboxes = 0;
 
 	for ( i = 1; i <= par->EN_GPSZ; i++ ) {
 		fprintf(file, "node %3d ", i);
@@ -199,16 +660,18 @@ int EmulNet::ENcleanup() {
 
 		for (j = 0; j < par->getcurrtime(); j++) {
 
-			sent_total += sent_msgs[i][j];
-			recv_total += recv_msgs[i][j];
+			int sent = sent_msgs.get(i, j);
+			int recv = recv_msgs.get(i, j);
+			sent_total += sent;
+			recv_total += recv;
 			if (i != 67) {
-				fprintf(file, " (%4d, %4d)", sent_msgs[i][j], recv_msgs[i][j]);
+				fprintf(file, " (%4d, %4d)", sent, recv);
 				if (j % 10 == 9) {
 					fprintf(file, "\n         ");
 				}
 			}
 			else {
-				fprintf(file, "special %4d %4d %4d\n", j, sent_msgs[i][j], recv_msgs[i][j]);
+				fprintf(file, "special %4d %4d %4d\n", j, sent, recv);
 			}
 		}
 		fprintf(file, "\n");
@@ -216,5 +679,243 @@ int EmulNet::ENcleanup() {
 	}
 
 	fclose(file);
+
+	if ( traceFile ) {
+		if ( replaying ) {
+			trace_rec rec;
+			if ( !diverged && 1 == fread(&rec, sizeof(rec), 1, traceFile) ) {
+				traceDiverged("run ended before the trace");
+			}
+			fprintf(stderr, "EmulNet replay: %ld events, %s\n", traceEvents, diverged ? "diverged" : "identical");
+		}
+		fclose(traceFile);
+		traceFile = NULL;
+	}
+
 	return 0;
 }
+
+/**
+ * FUNCTION NAME: ENrecord
+ *
+ * DESCRIPTION: Write every send, with its drop decision, and every delivery to a binary trace.
+ * 				Only the serial emulated network is traced
+ */
+void EmulNet::ENrecord(const char *path) {
+	traceFile = fopen(path, "wb");
+	if ( NULL == traceFile ) {
+		perror("EmulNet record");
+		exit(1);
+	}
+	replaying = false;
+}
+
+/**
+ * FUNCTION NAME: ENreplay
+ *
+ * DESCRIPTION: Take the drop decisions from a recorded trace instead of the random generator,
+ * 				and check that sends and deliveries match the recording. The first mismatch is
+ * 				reported, the rest of the run then decides drops itself
+ */
+void EmulNet::ENreplay(const char *path) {
+	traceFile = fopen(path, "rb");
+	if ( NULL == traceFile ) {
+		perror("EmulNet replay");
+		exit(1);
+	}
+	replaying = true;
+}
+
+/**
+ * FUNCTION NAME: checksum
+ *
+ * DESCRIPTION: FNV-1a hash of a payload
+ */
+static unsigned int checksum(char *data, int size) {
+	unsigned int h = 2166136261u;
+	for ( int i = 0; i < size; i++ ) {
+		h ^= (unsigned char)data[i];
+		h *= 16777619u;
+	}
+	return h;
+}
+
+/**
+ * FUNCTION NAME: traceDiverged
+ *
+ * DESCRIPTION: Report the first event where the run stopped following the trace
+ */
+void EmulNet::traceDiverged(const char *what) {
+	fprintf(stderr, "EmulNet replay diverged at event %ld, time %d: %s\n", traceEvents, par->getcurrtime(), what);
+	diverged = true;
+}
+
+/**
+ * FUNCTION NAME: traceSend
+ *
+ * DESCRIPTION: Record a send, or check it against the trace and return the recorded decision
+ *
+ * RETURNS:
+ * traceVerdict to apply
+ */
+int EmulNet::traceSend(Address *myaddr, Address *toaddr, char *data, int size, int verdict) {
+	trace_rec rec;
+
+	if ( replaying ) {
+		if ( diverged ) {
+			return verdict;
+		}
+		if ( 1 != fread(&rec, sizeof(rec), 1, traceFile) ) {
+			traceDiverged("trace ended");
+			return verdict;
+		}
+		traceEvents++;
+		if ( TRACE_SEND != rec.type || rec.time != par->getcurrtime() || rec.size != size ||
+			 memcmp(rec.from, myaddr->addr, sizeof(rec.from)) || memcmp(rec.to, toaddr->addr, sizeof(rec.to)) ) {
+			traceDiverged("different send");
+			return verdict;
+		}
+		if ( rec.sum != checksum(data, size) ) {
+			traceDiverged("different payload");
+			return verdict;
+		}
+		// A refusal follows from the buffer state, only the drop itself is replayed
+		if ( TRACE_REFUSED == verdict && TRACE_SENT == rec.verdict ) {
+			traceDiverged("send refused");
+			return verdict;
+		}
+		return rec.verdict;
+	}
+
+	memset(&rec, 0, sizeof(rec));
+	rec.type = TRACE_SEND;
+	rec.verdict = verdict;
+	memcpy(rec.from, myaddr->addr, sizeof(rec.from));
+	memcpy(rec.to, toaddr->addr, sizeof(rec.to));
+	rec.time = par->getcurrtime();
+	rec.size = size;
+	rec.sum = checksum(data, size);
+	fwrite(&rec, sizeof(rec), 1, traceFile);
+	traceEvents++;
+	return verdict;
+}
+
+/**
+ * FUNCTION NAME: traceDeliver
+ *
+ * DESCRIPTION: Record a delivery, or check it against the trace
+ */
+void EmulNet::traceDeliver(en_msg *em) {
+	trace_rec rec;
+
+	if ( replaying ) {
+		if ( diverged ) {
+			return;
+		}
+		if ( 1 != fread(&rec, sizeof(rec), 1, traceFile) ) {
+			traceDiverged("trace ended");
+			return;
+		}
+		traceEvents++;
+		if ( TRACE_DELIVER != rec.type || rec.time != par->getcurrtime() || rec.size != em->size ||
+			 memcmp(rec.from, em->from.addr, sizeof(rec.from)) || memcmp(rec.to, em->to.addr, sizeof(rec.to)) ) {
+			traceDiverged("different delivery");
+		}
+		return;
+	}
+
+	memset(&rec, 0, sizeof(rec));
+	rec.type = TRACE_DELIVER;
+	memcpy(rec.from, em->from.addr, sizeof(rec.from));
+	memcpy(rec.to, em->to.addr, sizeof(rec.to));
+	rec.time = par->getcurrtime();
+	rec.size = em->size;
+	rec.sum = checksum((char *)(em + 1), em->size);
+	fwrite(&rec, sizeof(rec), 1, traceFile);
+	traceEvents++;
+}
+
+/**
+ * FUNCTION NAME: schedule
+ *
+ * DESCRIPTION: Park a frame until time unit due
+ */
+void TimerWheel::schedule(int due, en_msg *em) {
+	wheel_entry e;
+	int level;
+
+	e.due = due;
+	e.em = em;
+
+	if ( due < now ) {
+		due = now;
+	}
+	for ( level = 0; level < WHEEL_LEVELS; level++ ) {
+		if ( (due >> (WHEEL_BITS * (level + 1))) == (now >> (WHEEL_BITS * (level + 1))) ) {
+			slots[level][(due >> (WHEEL_BITS * level)) & (WHEEL_SLOTS - 1)].push_back(e);
+			return;
+		}
+	}
+	overflow.push_back(e);
+}
+
+/**
+ * FUNCTION NAME: tick
+ *
+ * DESCRIPTION: Advance the wheel by one time unit. Slots of the higher levels are spread
+ * 				over the levels below when those wrap around, then the frames due now are
+ * 				appended to expired
+ */
+void TimerWheel::tick(vector<en_msg *> &expired) {
+	vector<wheel_entry> pending;
+	int level;
+
+	now++;
+
+	// Highest level that wrapped around
+	for ( level = 0; level < WHEEL_LEVELS; level++ ) {
+		if ( (now >> (WHEEL_BITS * level)) & (WHEEL_SLOTS - 1) ) {
+			break;
+		}
+	}
+	if ( level == WHEEL_LEVELS ) {
+		pending.swap(overflow);
+		for ( unsigned int i = 0; i < pending.size(); i++ ) {
+			schedule(pending[i].due, pending[i].em);
+		}
+		level--;
+	}
+	for ( ; level > 0; level-- ) {
+		pending.clear();
+		pending.swap(slots[level][(now >> (WHEEL_BITS * level)) & (WHEEL_SLOTS - 1)]);
+		for ( unsigned int i = 0; i < pending.size(); i++ ) {
+			schedule(pending[i].due, pending[i].em);
+		}
+	}
+
+	vector<wheel_entry> &slot = slots[0][now & (WHEEL_SLOTS - 1)];
+	for ( unsigned int i = 0; i < slot.size(); i++ ) {
+		expired.push_back(slot[i].em);
+	}
+	slot.clear();
+}
+
+/**
+ * FUNCTION NAME: clear
+ *
+ * DESCRIPTION: Drop every frame still on the wire
+ */
+void TimerWheel::clear() {
+	for ( int level = 0; level < WHEEL_LEVELS; level++ ) {
+		for ( int slot = 0; slot < WHEEL_SLOTS; slot++ ) {
+			for ( unsigned int i = 0; i < slots[level][slot].size(); i++ ) {
+				free(slots[level][slot][i].em);
+			}
+			slots[level][slot].clear();
+		}
+	}
+	for ( unsigned int i = 0; i < overflow.size(); i++ ) {
+		free(overflow[i].em);
+	}
+	overflow.clear();
+}
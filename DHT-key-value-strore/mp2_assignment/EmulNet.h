@@ -7,13 +7,17 @@
 #ifndef _EMULNET_H_
 #define _EMULNET_H_
 
-#define MAX_NODES 1000
-#define MAX_TIME 3600
-#define ENBUFFSIZE 30000
+#define ENSLABSIZE 16384
+#define ENFRAMEALIGN 16
+#define WHEEL_BITS 6
+#define WHEEL_SLOTS (1 << WHEEL_BITS)
+#define WHEEL_LEVELS 3
 
 #include "stdincludes.h"
 #include "Params.h"
 #include "Member.h"
+#include <unordered_map>
+#include <atomic>
 
 using namespace std;
 
@@ -27,8 +31,161 @@ typedef struct en_msg {
 	Address from;
 	// Destination node
 	Address to;
+	// Number of messages packed in the payload by ENsendv, 0 for a plain send
+	int parts;
 }en_msg;
 
+/**
+ * Struct Name: mailbox
+ *
+ * DESCRIPTION: Messages waiting for one destination. Frames are carved out of slabs owned
+ * 				by the EmulNet: pending slabs are being filled by senders, delivered slabs
+ * 				hold the frames the receiver is reading and go back to the EmulNet on ENrelease
+ */
+typedef struct mailbox {
+	// Frames in the order they were sent
+	vector<en_msg *> msgs;
+	vector<char *> pendingSlabs;
+	// Bytes used in the last pending slab
+	int slabUsed;
+	vector<char *> deliveredSlabs;
+	// Frames sent to this node and not yet received, including those still on the wire
+	int queued;
+	mailbox(): slabUsed(ENSLABSIZE), queued(0) {}
+}mailbox;
+
+/**
+ * Struct Name: en_frame
+ *
+ * DESCRIPTION: Frame on a lock-free mailbox: link to the frame pushed before it, then the message
+ */
+typedef struct en_frame {
+	en_frame *next;
+	en_msg msg;
+}en_frame;
+
+/**
+ * Struct Name: mpsc_box
+ *
+ * DESCRIPTION: Mailbox of one node in concurrent mode. Any thread pushes with a CAS on head,
+ * 				only the owning node pops, by taking the whole list at once
+ */
+typedef struct mpsc_box {
+	atomic<en_frame *> head;
+	// Frames handed to the node, freed by ENrelease
+	vector<en_frame *> delivered;
+	// Frames pushed and not yet taken
+	atomic<int> queued;
+	mpsc_box(): head(NULL), queued(0) {}
+}mpsc_box;
+
+/**
+ * Struct Name: en_counters
+ *
+ * DESCRIPTION: What happened to the frames one node sent
+ */
+typedef struct en_counters {
+	long sent;
+	// Payload bytes of the frames sent
+	long bytes;
+	// Lost to MSG_DROP_PROB
+	long dropped;
+	// Refused because the destination queue was at QUEUE_LIMIT
+	long overflowed;
+	// Refused because the frame was over MAX_MSG_SIZE
+	long oversized;
+	// State of the generator behind the drop decisions of the node, 0 until its first send
+	unsigned int dropState;
+	en_counters(): sent(0), bytes(0), dropped(0), overflowed(0), oversized(0), dropState(0) {}
+}en_counters;
+
+/**
+ * Backpressure of a destination: congested from 3/4 of QUEUE_LIMIT, full at QUEUE_LIMIT
+ */
+enum en_pressure { EN_CLEAR, EN_CONGESTED, EN_FULL };
+
+/**
+ * Struct Name: trace_rec
+ *
+ * DESCRIPTION: One event of a recorded EmulNet run, written to the trace file as is
+ */
+enum traceType { TRACE_SEND, TRACE_DELIVER };
+enum traceVerdict { TRACE_SENT, TRACE_DROPPED, TRACE_REFUSED };
+typedef struct trace_rec {
+	unsigned char type;
+	// What happened to a send, see traceVerdict
+	unsigned char verdict;
+	char from[6];
+	char to[6];
+	int time;
+	int size;
+	// FNV-1a of the payload
+	unsigned int sum;
+}trace_rec;
+
+/**
+ * Struct Name: wheel_entry
+ */
+typedef struct wheel_entry {
+	// Time unit at which the frame reaches its destination
+	int due;
+	en_msg *em;
+}wheel_entry;
+
+/**
+ * Class Name: TimerWheel
+ *
+ * DESCRIPTION: Hierarchical timer wheel holding the frames that are still on the wire.
+ * 				Level l has WHEEL_SLOTS slots of WHEEL_SLOTS^l time units each; a frame sits on
+ * 				the lowest level whose span still contains both now and its due time, and moves
+ * 				one level down every time the wheel below wraps around
+ */
+class TimerWheel {
+public:
+	int now;
+	vector<wheel_entry> slots[WHEEL_LEVELS][WHEEL_SLOTS];
+	// Frames due beyond the span of the top level
+	vector<wheel_entry> overflow;
+	TimerWheel(): now(0) {}
+	void schedule(int due, en_msg *em);
+	void tick(vector<en_msg *> &expired);
+	void clear();
+};
+
+/**
+ * Class Name: MsgCount
+ *
+ * DESCRIPTION: Message counter per node and time unit. Storage grows with the ids and
+ * 				time units that actually see traffic
+ */
+class MsgCount {
+public:
+	// counts[node][time]
+	vector<vector<int> > counts;
+	// With every node id present up front, threads updating different nodes never touch the same vector
+	void reserveNodes(int nodes) {
+		if ( nodes > (int)counts.size() ) {
+			counts.resize(nodes);
+		}
+	}
+	void inc(int node, int time) {
+		if ( node >= (int)counts.size() ) {
+			counts.resize(node + 1);
+		}
+		vector<int> &series = counts[node];
+		if ( time >= (int)series.size() ) {
+			series.resize(time + 1, 0);
+		}
+		series[time]++;
+	}
+	int get(int node, int time) {
+		if ( node >= (int)counts.size() || time >= (int)counts[node].size() ) {
+			return 0;
+		}
+		return counts[node][time];
+	}
+};
+
 /**
  * Class Name: EM
  */
@@ -37,19 +194,27 @@ public:
 	int nextid;
 	int currbuffsize;
 	int firsteltindex;
-	en_msg* buff[ENBUFFSIZE];
+	// Per-destination mailboxes, keyed by the 6 byte address of the receiver
+	unordered_map<unsigned long long, mailbox> inbox;
+	// Slabs released by the receivers, reused before asking malloc for more
+	vector<char *> freeSlabs;
 	EM() {}
 	EM& operator = (EM &anotherEM) {
 		this->nextid = anotherEM.getNextId();
 		this->currbuffsize = anotherEM.getCurrBuffSize();
 		this->firsteltindex = anotherEM.getFirstEltIndex();
-		int i = this->currbuffsize;
-		while (i > 0) {
-			this->buff[i] = anotherEM.buff[i];
-			i--;
-		}
+		this->inbox = anotherEM.inbox;
+		this->freeSlabs = anotherEM.freeSlabs;
 		return *this;
 	}
+	/**
+	 * Mailbox key of an address: all 6 bytes (id and port) packed into an integer
+	 */
+	static unsigned long long key(Address *addr) {
+		unsigned long long k = 0;
+		memcpy(&k, addr->addr, sizeof(addr->addr));
+		return k;
+	}
 	int getNextId() {
 		return nextid;
 	}
@@ -78,22 +243,58 @@ public:
  */
 class EmulNet
 { 	
-private:
+protected:
 	Params* par;
-	int sent_msgs[MAX_NODES + 1][MAX_TIME];
-	int recv_msgs[MAX_NODES + 1][MAX_TIME];
+	MsgCount sent_msgs;
+	MsgCount recv_msgs;
 	int enInited;
 	EM emulnet;
+	// Link model state: frames on the wire and the time each link finishes its backlog
+	TimerWheel wheel;
+	map<pair<unsigned long long, unsigned long long>, double> linkFreeAt;
+	// Concurrent mode: one lock-free mailbox per node id, indexed by id
+	bool concurrent;
+	mpsc_box *boxes;
+	int nboxes;
+	// Per sending node, indexed by id
+	vector<en_counters> counters;
+	// Record/replay: trace file, and whether events are read from it instead of written
+	FILE *traceFile;
+	bool replaying;
+	bool diverged;
+	long traceEvents;
+	int dropRoll(Address *myaddr);
+	virtual int sendFrame(Address *myaddr, Address *toaddr, char *data, int size, int parts);
+	int deliverFrame(en_msg *em, int (* enq)(void *, char *, int), void *queue);
+	en_counters &countersOf(Address *addr);
+private:
+	en_msg *allocFrame(mailbox &box, int frameSize);
+	int arrivalTime(Address *myaddr, Address *toaddr, int frameSize);
+	void advanceWheel();
+	int packedSend(Address *myaddr, Address *toaddr, vector<char> &buf, vector<unsigned int> &packed,
+			const vector<string> &msgs, vector<string> *unsent);
+	int sendConcurrent(Address *myaddr, Address *toaddr, char *data, int size, int parts);
+	int recvConcurrent(Address *myaddr, int (* enq)(void *, char *, int), void *queue);
+	int traceSend(Address *myaddr, Address *toaddr, char *data, int size, int verdict);
+	void traceDeliver(en_msg *em);
+	void traceDiverged(const char *what);
 public:
  	EmulNet(Params *p);
- 	EmulNet(EmulNet &anotherEmulNet);
- 	EmulNet& operator = (EmulNet &anotherEmulNet);
+ 	// A copy would share the mailboxes and the trace file of the original
+ 	EmulNet(EmulNet &anotherEmulNet) = delete;
+ 	EmulNet& operator = (EmulNet &anotherEmulNet) = delete;
  	virtual ~EmulNet();
-	void *ENinit(Address *myaddr, short port);
-	int ENsend(Address *myaddr, Address *toaddr, string data);
+	virtual void *ENinit(Address *myaddr, short port);
+	int ENsend(Address *myaddr, Address *toaddr, const string &data);
 	int ENsend(Address *myaddr, Address *toaddr, char *data, int size);
-	int ENrecv(Address *myaddr, int (* enq)(void *, char *, int), struct timeval *t, int times, void *queue);
-	int ENcleanup();
+	int ENsendv(Address *myaddr, Address *toaddr, const vector<string> &msgs, vector<string> *unsent = NULL);
+	virtual int ENrecv(Address *myaddr, int (* enq)(void *, char *, int), struct timeval *t, int times, void *queue);
+	virtual void ENrelease(Address *myaddr);
+	virtual int ENcleanup();
+	en_pressure ENpressure(Address *toaddr);
+	void ENreport(FILE *file, const char *name);
+	void ENrecord(const char *path);
+	void ENreplay(const char *path);
 };
 
 #endif /* _EMULNET_H_ */
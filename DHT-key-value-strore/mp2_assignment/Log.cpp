@@ -5,6 +5,10 @@
  **********************************/
 
 #include "Log.h"
+#include <mutex>
+
+// Nodes may log from several threads, LOG works on shared static buffers
+static mutex logLock;
 
 /**
  * Constructor
@@ -42,6 +46,7 @@ Log::~Log() {}
  * DESCRIPTION: Print out to file dbg.log, along with Address of node.
  */
 void Log::LOG(Address *addr, const char * str, ...) {
+	lock_guard<mutex> guard(logLock);
 
 	static FILE *fp;
 	static FILE *fp2;
@@ -114,7 +119,7 @@ void Log::LOG(Address *addr, const char * str, ...) {
  * DESCRIPTION: To Log a node add
  */
 void Log::logNodeAdd(Address *thisNode, Address *addedAddr) {
-	static char stdstring[100];
+	char stdstring[100];
 	sprintf(stdstring, "Node %d.%d.%d.%d:%d joined at time %d", addedAddr->addr[0], addedAddr->addr[1], addedAddr->addr[2], addedAddr->addr[3], *(short *)&addedAddr->addr[4], par->getcurrtime());
     LOG(thisNode, stdstring);
 }
@@ -125,7 +130,7 @@ void Log::logNodeAdd(Address *thisNode, Address *addedAddr) {
  * DESCRIPTION: To log a node remove
  */
 void Log::logNodeRemove(Address *thisNode, Address *removedAddr) {
-	static char stdstring[30];
+	char stdstring[100];
 	sprintf(stdstring, "Node %d.%d.%d.%d:%d removed at time %d", removedAddr->addr[0], removedAddr->addr[1], removedAddr->addr[2], removedAddr->addr[3], *(short *)&removedAddr->addr[4], par->getcurrtime());
     LOG(thisNode, stdstring);
 }
@@ -136,7 +141,7 @@ void Log::logNodeRemove(Address *thisNode, Address *removedAddr) {
  * DESCRTION: Call this function after successfully create a key value pair
  */
 void Log::logCreateSuccess(Address * address, bool isCoordinator, int transID, string key, string value){
-	static char stdstring[100];
+	char stdstring[100];
 	string str;
 	if (isCoordinator)
 		str = "coordinator";
@@ -152,7 +157,7 @@ void Log::logCreateSuccess(Address * address, bool isCoordinator, int transID, s
  * DESCRIPTION: Call this function after successfully reading a key
  */
 void Log::logReadSuccess(Address * address, bool isCoordinator, int transID, string key, string value){
-    static char stdstring[100];
+    char stdstring[100];
 	string str;
 	if (isCoordinator)
 		str = "coordinator";
@@ -168,7 +173,7 @@ void Log::logReadSuccess(Address * address, bool isCoordinator, int transID, str
  * DESCRIPTION: Call this function after successfully updating a key
  */
 void Log::logUpdateSuccess(Address * address, bool isCoordinator, int transID, string key, string newValue){
-    static char stdstring[100];
+    char stdstring[100];
 	string str;
 	if (isCoordinator)
 		str = "coordinator";
@@ -184,7 +189,7 @@ void Log::logUpdateSuccess(Address * address, bool isCoordinator, int transID, s
  * DESCRIPTION: Call this function after successfully deleting a key
  */
 void Log::logDeleteSuccess(Address * address, bool isCoordinator, int transID, string key){
-    static char stdstring[100];
+    char stdstring[100];
 	string str;
 	if (isCoordinator)
 		str = "coordinator";
@@ -200,7 +205,7 @@ void Log::logDeleteSuccess(Address * address, bool isCoordinator, int transID, s
  * DESCRIPTION: Call this function if CREATE failed
  */
 void Log::logCreateFail(Address * address, bool isCoordinator, int transID, string key, string value){
-	static char stdstring[100];
+	char stdstring[100];
 	string str;
 	if (isCoordinator)
 		str = "coordinator";
@@ -217,7 +222,7 @@ void Log::logCreateFail(Address * address, bool isCoordinator, int transID, stri
  * DESCRIPTION: Call this function if READ failed
  */
 void Log::logReadFail(Address * address, bool isCoordinator, int transID, string key){
-    static char stdstring[100];
+    char stdstring[100];
 	string str;
 	if (isCoordinator)
 		str = "coordinator";
@@ -233,7 +238,7 @@ void Log::logReadFail(Address * address, bool isCoordinator, int transID, string
  * DESCRIPTION: Call this function if UPDATE failed
  */
 void Log::logUpdateFail(Address * address, bool isCoordinator, int transID, string key, string newValue){
-    static char stdstring[100];
+    char stdstring[100];
 	string str;
 	if (isCoordinator)
 		str = "coordinator";
@@ -249,7 +254,7 @@ void Log::logUpdateFail(Address * address, bool isCoordinator, int transID, stri
  * DESCRIPTION: Call this function if DELETE failed
  */
 void Log::logDeleteFail(Address * address, bool isCoordinator, int transID, string key){
-    static char stdstring[100];
+    char stdstring[100];
 	string str;
 	if (isCoordinator)
 		str = "coordinator";
@@ -27,6 +27,20 @@ MP1Node::MP1Node(Member *member, Params *params, EmulNet *emul, Log *log, Addres
     this->log = log;
     this->par = params;
     this->memberNode->addr = *address;
+    this->version = 0;
+    this->lastRoundVersion = -1;
+    this->gossipRound = 0;
+    this->incarnation = 0;
+    this->gossipNext = 0;
+    this->joinAttempts = 0;
+    this->joinSentAt = 0;
+    this->probeNext = 0;
+    this->probeTarget = 0;
+    this->probeAcked = true;
+    this->viewHoles = false;
+    this->viewChanged = true;
+    seed_seq seed{params->SEED, (unsigned int)*(int *)(address->addr)};
+    this->rng.seed(seed);
 }
 
 /**
@@ -56,11 +70,12 @@ int MP1Node::recvLoop()
  * FUNCTION NAME: enqueueWrapper
  *
  * DESCRIPTION: Enqueue the message from Emulnet into the queue
+ * 				The buffer is owned by Emulnet and released after checkMessages
  */
 int MP1Node::enqueueWrapper(void *env, char *buff, int size)
 {
     Queue q;
-    return q.enqueue((queue<q_elt> *)env, (void *)buff, size);
+    return q.enqueue((RingQueue<q_elt> *)env, (void *)buff, size);
 }
 
 /**
@@ -113,7 +128,7 @@ int MP1Node::initThisNode(Address *joinaddr)
     // node is up!
     memberNode->nnb = 0;
     memberNode->heartbeat = 0;
-    memberNode->pingCounter = TFAIL;
+    memberNode->pingCounter = 0;
     memberNode->timeOutCounter = -1;
     initMemberListTable(memberNode);
 
@@ -127,7 +142,6 @@ int MP1Node::initThisNode(Address *joinaddr)
  */
 int MP1Node::introduceSelfToGroup(Address *joinaddr)
 {
-    MessageHdr *msg;
 #ifdef DEBUGLOG
     static char s[1024];
 #endif
@@ -145,17 +159,12 @@ int MP1Node::introduceSelfToGroup(Address *joinaddr)
         short port;
         memcpy((char *)&id, (char *)&memberNode->addr.addr[0], sizeof(int));
         memcpy((char *)&port, (char *)&memberNode->addr.addr[4], sizeof(short));
-        // MemberListEntry entry(id, port, memberNode->heartbeat, par->getcurrtime());
-        MemberListEntry *firstNode = new MemberListEntry(id, port);
-        memberNode->memberList.push_back(*firstNode);
+        addMember(MemberListEntry(id, port));
     }
     else
     {
-        msg = new MessageHdr();
-
         // create JOINREQ message: format of data is {struct Address myaddr}
-        msg->msgType = JOINREQ;
-        msg->addr = Address(memberNode->addr);
+        createMessage(JOINREQ, &outMsg);
 
 #ifdef DEBUGLOG
         sprintf(s, "Trying to join...");
@@ -163,9 +172,8 @@ int MP1Node::introduceSelfToGroup(Address *joinaddr)
 #endif
 
         // send JOINREQ message to introducer member
-        emulNet->ENsend(&memberNode->addr, joinaddr, (char *)msg, sizeof(MessageHdr));
-
-        free(msg);
+        sendMessage(&outMsg, joinaddr);
+        joinSentAt = par->getcurrtime();
     }
 
     return 1;
@@ -203,6 +211,13 @@ void MP1Node::nodeLoop()
     // Wait until you're in the group...
     if (!memberNode->inGroup)
     {
+        // ...asking the next introducer when the last one did not answer in time
+        if (par->getcurrtime() - joinSentAt >= JOIN_RETRY_TIMEOUT)
+        {
+            joinAttempts++;
+            Address joinaddr = getJoinAddress();
+            introduceSelfToGroup(&joinaddr);
+        }
         return;
     }
 
@@ -230,6 +245,9 @@ void MP1Node::checkMessages()
         memberNode->mp1q.pop();
         recvCallBack((void *)memberNode, (char *)ptr, size);
     }
+
+    // All queued buffers are consumed, give their frames back to EmulNet
+    emulNet->ENrelease(&memberNode->addr);
     return;
 }
 
@@ -240,79 +258,126 @@ void MP1Node::checkMessages()
  */
 bool MP1Node::recvCallBack(void *env, char *data, int size)
 {
-    MessageHdr *msg = (MessageHdr *)data;
+    MessageHdr *msg = &inMsg;
+
+    if (!decodeMessage(data, size, msg))
+    {
+#ifdef DEBUGLOG
+        log->LOG(&memberNode->addr, "Dropping a malformed message");
+#endif
+        return false;
+    }
 
     // printf("recvCallBack: msgtype: %d\n", (msg->msgType));
     if (msg->msgType == JOINREQ)
     {
+        // An introducer that has not joined yet has no member list to give, the joiner
+        // moves on to another introducer after JOIN_RETRY_TIMEOUT
+        if (!memberNode->inGroup)
+        {
+            return false;
+        }
+
         /* Adding to memberList */
         addNewNode(msg);
 
         /* Sending JOINREP */
-        MessageHdr *repMsg = createMessage(JOINREP);
-        emulNet->ENsend(&memberNode->addr, &msg->addr, (char *)repMsg, sizeof(MessageHdr));
-        free(repMsg);
+        createMessage(JOINREP, &outMsg);
+        sendMessage(&outMsg, &msg->addr);
+    }
+    else if (msg->msgType == JOINREP && par->MEMBERSHIP == PARTIAL_MEMBERSHIP)
+    {
+        // Only the view of the introducer comes back, keep what fits
+        memberNode->inGroup = true;
+        for (uint i = 0; i < msg->memberList.size(); i++)
+        {
+            considerMember(msg->memberList[i]);
+        }
     }
     else if (msg->msgType == JOINREP)
     {
-        memberNode->memberList = vector<MemberListEntry>(msg->memberList);
+        // Added one by one, so the KV store hears of every member through the change feed
         memberNode->inGroup = true;
-
-        for (uint i = 0; i < memberNode->memberList.size(); i++)
+        for (uint i = 0; i < msg->memberList.size(); i++)
         {
-            char addr[6];
-            *(int *)&addr[0] = memberNode->memberList[i].id;
-            *(short *)&addr[4] = memberNode->memberList[i].port;
-            if (memcmp((char *)&addr, (char *)&memberNode->addr.addr, 6) != 0)
+            if (!addMember(msg->memberList[i]))
+            {
+                continue;
+            }
+            Address a = getAddressFromId(msg->memberList[i].id, msg->memberList[i].port);
+            if (memcmp((char *)&a.addr, (char *)&memberNode->addr.addr, 6) != 0)
             {
-                Address *a = new Address();
-                memcpy((char *)&a->addr[0], (char *)&addr[0], sizeof(addr));
-                log->logNodeAdd(&memberNode->addr, a);
+                log->logNodeAdd(&memberNode->addr, &a);
             }
         }
     }
-    else if (msg->msgType == GOSSIP){       
+    else if (msg->msgType == GOSSIP || msg->msgType == HEARTBEAT){       
         gossipHandler(msg);
     }
+    else if (msg->msgType == SHUFFLE || msg->msgType == SHUFFLEREP)
+    {
+        shuffleHandler(msg);
+    }
+    else
+    {
+        swimHandler(msg);
+    }
 
     return 0;
 }
 
 void MP1Node::gossipHandler(MessageHdr *msg){
     //Update the heartbeat of the member from whom the message was received
-    for(int k = 0; k < (int)memberNode->memberList.size(); k++){
-        if(msg->addr == *getAddressFromId(memberNode->memberList[k].id, memberNode->memberList[k].port)){
-            memberNode->memberList[k].heartbeat += 1;
-            memberNode->memberList[k].timestamp = par->getcurrtime();
+    int senderId;
+    short senderPort;
+    memcpy((char *)&senderId, (char *)&msg->addr.addr[0], sizeof(int));
+    memcpy((char *)&senderPort, (char *)&msg->addr.addr[4], sizeof(short));
+    MemberListEntry *sender = findMember(senderId, senderPort);
+    if(sender){
+        sender->heartbeat += 1;
+        heardFrom(sender);
+    }
+    else if(par->MEMBERSHIP == PARTIAL_MEMBERSHIP){
+        // The sender monitors this node without being monitored back, answer so it hears from us
+        if(msg->msgType == GOSSIP){
+            createMessage(HEARTBEAT, &outMsg);
+            sendMessage(&outMsg, &msg->addr);
         }
+        deadHeartbeat.erase(MemberIndex::pack(senderId, senderPort));
+        considerMember(MemberListEntry(senderId, senderPort, 0, par->getcurrtime()));
     }
 
     for(int i = 0; i < (int)msg->memberList.size(); i++){
-        bool entryExists = false;
+        MemberListEntry &gossiped = msg->memberList[i];
+        MemberListEntry *known = findMember(gossiped.id, gossiped.port);
 
-        for(int j = 0; j < (int)memberNode->memberList.size(); j++){
-            //Check if the node from msg->memberlist exists in the membernode->mamberlist
-            if(msg->memberList[i].id == memberNode->memberList[j].id && msg->memberList[i].port == memberNode->memberList[j].port){
-                entryExists = true;
-                //Now update the above node's heartbeat
-                if(msg->memberList[i].heartbeat > memberNode->memberList[j].heartbeat){
-                    memberNode->memberList[j].heartbeat = msg->memberList[i].heartbeat;
-                    memberNode->memberList[j].timestamp = par->getcurrtime();
-                }
-                break;
+        if(known){
+            //Now update the above node's heartbeat
+            if(gossiped.heartbeat > known->heartbeat){
+                known->heartbeat = gossiped.heartbeat;
+                heardFrom(known);
             }
+            continue;
         }
 
-        //Add node to membership list if entryExists remains false
-        if(!entryExists){
-            MemberListEntry *newMember = new MemberListEntry(msg->memberList[i]);
-            newMember->timestamp = par->getcurrtime();
-            newMember->heartbeat = msg->memberList[i].heartbeat;
-            memberNode->memberList.push_back(*newMember);
-            Address *newAddr = getAddressFromId((int)newMember->id, (short)newMember->port);
-            log->logNodeAdd(&memberNode->addr, newAddr);
-            delete(newAddr);
+        if(par->MEMBERSHIP == PARTIAL_MEMBERSHIP){
+            considerMember(gossiped);
+            continue;
         }
+
+        //Add node to membership list if it is not known yet, or alive again since it was removed
+        unordered_map<unsigned long long, long>::iterator dead = deadHeartbeat.find(MemberIndex::pack(gossiped.id, gossiped.port));
+        if(dead != deadHeartbeat.end()){
+            if(gossiped.heartbeat <= dead->second){
+                continue;
+            }
+            deadHeartbeat.erase(dead);
+        }
+        MemberListEntry newMember(gossiped);
+        newMember.timestamp = par->getcurrtime();
+        addMember(newMember);
+        Address newAddr = getAddressFromId((int)newMember.id, (short)newMember.port);
+        log->logNodeAdd(&memberNode->addr, &newAddr);
     }
 }
 
@@ -321,32 +386,55 @@ void MP1Node::addNewNode(MessageHdr *msg){
     short port;
     memcpy((char *)&id, (char *)&msg->addr.addr[0], sizeof(int));
     memcpy((char *)&port, (char *)&msg->addr.addr[4], sizeof(short));
-    MemberListEntry *entry = new MemberListEntry(id, port, 0, par->getcurrtime());
-    memberNode->memberList.push_back(*entry);
+    MemberListEntry *known = findMember(id, port);
+    if(known){
+        // Rejoining node, start it over
+        known->heartbeat = 0;
+        known->timestamp = par->getcurrtime();
+        arrivals[known - &memberNode->memberList[0]] = PhiDetector();
+        touchMember(known);
+        return;
+    }
+    if (par->MEMBERSHIP == PARTIAL_MEMBERSHIP)
+    {
+        deadHeartbeat.erase(MemberIndex::pack(id, port));
+        considerMember(MemberListEntry(id, port, 0, par->getcurrtime()));
+        return;
+    }
+    addMember(MemberListEntry(id, port, 0, par->getcurrtime()));
     log->logNodeAdd(&memberNode->addr, &msg->addr);
+    deadHeartbeat.erase(MemberIndex::pack(id, port));
+    if (par->MEMBERSHIP == SWIM_MEMBERSHIP)
+    {
+        swimDisseminate(id, port, 0, SWIM_ALIVE);
+    }
 }
 
-MessageHdr* MP1Node::createMessage(MsgTypes t){
-    MessageHdr *newMsg = new MessageHdr();
-    newMsg->msgType = t;
+/**
+ * FUNCTION NAME: createMessage
+ *
+ * DESCRIPTION: Build a message of type t from this node into msg. A GOSSIP carries the fresh
+ * 				entries changed after version since, or all fresh entries when since is -1.
+ * 				The member list of msg is cleared, not freed, so a reused message stops allocating
+ * 				once it has held the longest list
+ */
+void MP1Node::createMessage(MsgTypes t, MessageHdr *msg, long since){
+    msg->msgType = t;
+    msg->addr = memberNode->addr;
+    msg->memberList.clear();
 
     if(t == JOINREP){
-        newMsg->memberList = vector<MemberListEntry>(memberNode->memberList);
-        newMsg->addr = Address(memberNode->addr);
+        msg->memberList.insert(msg->memberList.end(), memberNode->memberList.begin(), memberNode->memberList.end());
+        msg->memberList.insert(msg->memberList.end(), passiveView.begin(), passiveView.end());
     }
     else if(t == GOSSIP){
-        //Create modified list based on TFAIL
-        vector<MemberListEntry> newList;
+        //Leave out suspected members
         for(int j = 0; j < (int)memberNode->memberList.size(); j++){
-            if(par->getcurrtime() - memberNode->memberList[j].timestamp < TFAIL){
-                newList.push_back(memberNode->memberList[j]);
+            if(phiOf(j) < par->PHI_SUSPECT && entryVersion[j] > since){
+                msg->memberList.push_back(memberNode->memberList[j]);
             }
         }
-        newMsg->memberList = vector<MemberListEntry>(newList);
-        newMsg->addr = Address(memberNode->addr);
     }
-    
-    return newMsg;
 }
 
 /**
@@ -358,6 +446,12 @@ MessageHdr* MP1Node::createMessage(MsgTypes t){
  */
 void MP1Node::nodeLoopOps()
 {
+    if (par->MEMBERSHIP == SWIM_MEMBERSHIP)
+    {
+        swimLoop();
+        return;
+    }
+
     int id;
     short port;
     memcpy((char *)&id, (char *)&memberNode->addr.addr[0], sizeof(int));
@@ -365,62 +459,896 @@ void MP1Node::nodeLoopOps()
 
     /* Update heartbeat value */
     memberNode->heartbeat++;
-    for (int i = 0; i <(int)memberNode->memberList.size(); i++){
-        /* Update heartbeat value in memberList */
-        if (id == memberNode->memberList[i].id && port == memberNode->memberList[i].port){
-            memberNode->memberList[i].heartbeat = memberNode->heartbeat;
-            memberNode->memberList[i].timestamp = par->getcurrtime();
-            break;
-        }
+    /* Update heartbeat value in memberList */
+    MemberListEntry *self = findMember(id, port);
+    if (self){
+        self->heartbeat = memberNode->heartbeat;
+        self->timestamp = par->getcurrtime();
+        touchMember(self);
     }
 
-    /* Remove failed nodes after TREMOVE */
+    /* Remove failed nodes once their suspicion reaches PHI_REMOVE */
     removeFailedNode();
 
     /* Send gossip messages */
     sendGossips();
 
+    /* Refill the partial view after failures and exchange views now and then */
+    if (par->MEMBERSHIP == PARTIAL_MEMBERSHIP)
+    {
+        if (viewHoles)
+        {
+            promotePassive();
+        }
+        if ((par->getcurrtime() + id) % par->SHUFFLE_PERIOD == 0)
+        {
+            sendShuffle();
+        }
+    }
+
     return;
 }
 
 void MP1Node::removeFailedNode(){
     for(int i = 0; i < (int)memberNode->memberList.size(); i++){
-        //Check if recorded timestamp is within the time limit TREMOVE
-        if(par->getcurrtime() - memberNode->memberList[i].timestamp > TREMOVE){
-            Address *removeAddr = getAddressFromId(memberNode->memberList[i].id, memberNode->memberList[i].port);
-            log->logNodeRemove(&memberNode->addr, removeAddr);
-            memberNode->memberList.erase(memberNode->memberList.begin() + i);
-            delete removeAddr;
+        //Check if the silence since the last heartbeat is still plausible for this member
+        if(phiOf(i) > par->PHI_REMOVE){
+            Address removeAddr = getAddressFromId(memberNode->memberList[i].id, memberNode->memberList[i].port);
+            log->logNodeRemove(&memberNode->addr, &removeAddr);
+            deadHeartbeat[MemberIndex::pack(memberNode->memberList[i].id, memberNode->memberList[i].port)] = memberNode->memberList[i].heartbeat;
+            removeMember(i, MEMBER_FAILED);
+            viewHoles = true;
+            // The last entry moved into slot i, look at it again
+            i--;
         }
     }
 }
 
+/**
+ * Address of a member from its packed (id, port) key
+ */
+static Address addressOfKey(unsigned long long key)
+{
+    Address a;
+    int id = (int)(key >> 16);
+    short port = (short)(key & 0xffff);
+    memcpy(&a.addr[0], &id, sizeof(int));
+    memcpy(&a.addr[4], &port, sizeof(short));
+    return a;
+}
+
+static unsigned long long keyOfAddress(Address *addr)
+{
+    int id;
+    short port;
+    memcpy(&id, &addr->addr[0], sizeof(int));
+    memcpy(&port, &addr->addr[4], sizeof(short));
+    return MemberIndex::pack(id, port);
+}
+
 void MP1Node::sendGossips(){
-    for(int i = 0; i < GOSSIP_FANOUT_VALUE; i++){
-        //Randomize the nodes that get the gossip messages
-        int n = rand() % memberNode->memberList.size();
-        
-        //Create gossip message and send it to the above 'n-th' node
-        MessageHdr* gossipMsg = createMessage(GOSSIP);
-        Address *sendAddr = getAddressFromId(memberNode->memberList[n].id, memberNode->memberList[n].port);
-        emulNet->ENsend(&memberNode->addr, sendAddr, (char *)gossipMsg, sizeof(MessageHdr));
-        delete sendAddr;
-        free(gossipMsg); 
+    // Each change goes out in the round after it happened, to the fanout peers, who pass it on.
+    // Every GOSSIP_FULL_SYNC rounds peers get the full list, which repairs lost deltas
+    bool fullSync = (gossipRound++ % par->GOSSIP_FULL_SYNC) == 0;
+    long since = fullSync ? -1 : lastRoundVersion;
+    lastRoundVersion = version;
+
+    gossipTargets.clear();
+    if(par->MEMBERSHIP == PARTIAL_MEMBERSHIP){
+        // A partial view is small enough to gossip to all of it every round, which is also what
+        // keeps the heartbeats of members that do not monitor this node coming
+        unsigned long long self = keyOfAddress(&memberNode->addr);
+        for(int i = 0; i < (int)memberNode->memberList.size(); i++){
+            unsigned long long key = MemberIndex::pack(memberNode->memberList[i].id, memberNode->memberList[i].port);
+            if(key != self){
+                gossipTargets.push_back(addressOfKey(key));
+            }
+        }
+    }
+    else{
+        //Walk a shuffled order of the peers, so each one hears from this node at least once
+        //every (size - 1) / GOSSIP_FANOUT_VALUE + 1 rounds, and never twice in a round
+        int targets = min(GOSSIP_FANOUT_VALUE, (int)memberNode->memberList.size() - 1);
+        unsigned long long sent[GOSSIP_FANOUT_VALUE];
+        int count = 0;
+        for(int tries = 0; count < targets && tries < 2 * targets; tries++){
+            unsigned long long key = nextPeer(gossipOrder, gossipNext);
+            if(0 == key || find(sent, sent + count, key) != sent + count){
+                continue;
+            }
+            sent[count++] = key;
+            gossipTargets.push_back(addressOfKey(key));
+        }
+    }
+
+    //Every peer of the round gets the same message, encoded once
+    if(!gossipTargets.empty()){
+        createMessage(GOSSIP, &outMsg, since);
+        sendMessage(&outMsg, gossipTargets.data(), gossipTargets.size());
     }
 }
 
+/**
+ * FUNCTION NAME: nextPeer
+ *
+ * DESCRIPTION: Next member in a round-robin order of the other members. When the order runs
+ * 				out a new random permutation is drawn. Members removed since it was drawn are
+ * 				skipped. addMember puts new gossip peers in the part still to come, new SWIM probe
+ * 				targets wait for the next permutation
+ *
+ * RETURNS:
+ * Packed (id, port) of the member, 0 if no other member is known
+ */
+unsigned long long MP1Node::nextPeer(vector<unsigned long long> &order, unsigned int &next)
+{
+    vector<MemberListEntry> &list = memberNode->memberList;
+    unsigned long long self = keyOfAddress(&memberNode->addr);
+
+    for (int tries = 0; tries < 2; tries++)
+    {
+        if (next >= order.size())
+        {
+            order.clear();
+            for (unsigned int i = 0; i < list.size(); i++)
+            {
+                unsigned long long key = MemberIndex::pack(list[i].id, list[i].port);
+                if (key != self)
+                {
+                    order.push_back(key);
+                }
+            }
+            shuffle(order.begin(), order.end(), rng);
+            next = 0;
+        }
+        while (next < order.size())
+        {
+            unsigned long long key = order[next++];
+            if (memberIndex.find((int)(key >> 16), (short)(key & 0xffff)) >= 0)
+            {
+                return key;
+            }
+        }
+    }
+    return 0;
+}
+
+/**
+ * FUNCTION NAME: swimLoop
+ *
+ * DESCRIPTION: SWIM duties of one time unit. Suspects whose timeout ran out are confirmed dead.
+ * 				Every SWIM_PERIOD the next member in shuffled order is pinged; without an ack after
+ * 				SWIM_ACK_TIMEOUT, SWIM_PROXIES other members are asked to ping it, and without any
+ * 				ack by the end of the period it becomes suspect. Periods of different nodes are staggered
+ */
+void MP1Node::swimLoop()
+{
+    vector<MemberListEntry> &list = memberNode->memberList;
+    unsigned long long self = keyOfAddress(&memberNode->addr);
+    long now = par->getcurrtime();
+
+    for (int i = 0; i < (int)list.size(); i++)
+    {
+        if (suspectSince[i] >= 0 && now - suspectSince[i] >= par->SWIM_SUSPECT_TIMEOUT)
+        {
+            Address dead = addressOfKey(MemberIndex::pack(list[i].id, list[i].port));
+            log->logNodeRemove(&memberNode->addr, &dead);
+            swimDisseminate(list[i].id, list[i].port, list[i].heartbeat, SWIM_CONFIRM);
+            deadHeartbeat[MemberIndex::pack(list[i].id, list[i].port)] = list[i].heartbeat;
+            removeMember(i, MEMBER_FAILED);
+            i--;
+        }
+    }
+
+    int phase = (now + (self >> 16)) % par->SWIM_PERIOD;
+    if (phase == 0)
+    {
+        // The previous probe got no ack at all
+        if (!probeAcked)
+        {
+            int pos = memberIndex.find((int)(probeTarget >> 16), (short)(probeTarget & 0xffff));
+            if (pos >= 0 && suspectSince[pos] < 0)
+            {
+                suspectSince[pos] = now;
+                swimDisseminate(list[pos].id, list[pos].port, list[pos].heartbeat, SWIM_SUSPECT);
+            }
+        }
+
+        probeAcked = true;
+        probeTarget = nextPeer(probeOrder, probeNext);
+
+        if (probeTarget)
+        {
+            Address target = addressOfKey(probeTarget);
+            probeAcked = false;
+            swimSend(PING, &target, &target);
+        }
+    }
+    else if (phase == SWIM_ACK_TIMEOUT && !probeAcked && list.size() > 2)
+    {
+        Address target = addressOfKey(probeTarget);
+        vector<unsigned long long> &proxies = proxyScratch;
+        proxies.clear();
+        for (unsigned int i = 0; i < list.size(); i++)
+        {
+            unsigned long long key = MemberIndex::pack(list[i].id, list[i].port);
+            if (key != self && key != probeTarget)
+            {
+                proxies.push_back(key);
+            }
+        }
+        // Partial shuffle: SWIM_PROXIES distinct members, or all of them if there are fewer
+        int count = min(par->SWIM_PROXIES, (int)proxies.size());
+        for (int k = 0; k < count; k++)
+        {
+            swap(proxies[k], proxies[k + rng() % (proxies.size() - k)]);
+            Address proxyAddr = addressOfKey(proxies[k]);
+            swimSend(PINGREQ, &proxyAddr, &target);
+        }
+    }
+}
+
+/**
+ * FUNCTION NAME: swimHandler
+ *
+ * DESCRIPTION: Handle a SWIM message. Its piggybacked updates are applied first, then
+ * 				PING is acked, PINGREQ makes this node ping the target for the sender (IPING,
+ * 				target is the origin), IPING is acked to the proxy (IACK, target is the origin),
+ * 				and IACK is passed to the origin as an ACK. An ACK's target is the member it
+ * 				proves alive
+ */
+void MP1Node::swimHandler(MessageHdr *msg)
+{
+    unsigned long long sender = keyOfAddress(&msg->addr);
+
+    // Direct contact is proof enough of a member nobody told us about
+    if (memberIndex.find((int)(sender >> 16), (short)(sender & 0xffff)) < 0 && deadHeartbeat.find(sender) == deadHeartbeat.end())
+    {
+        addMember(MemberListEntry((int)(sender >> 16), (short)(sender & 0xffff), 0, par->getcurrtime()));
+        log->logNodeAdd(&memberNode->addr, &msg->addr);
+    }
+
+    for (unsigned int i = 0; i < msg->memberList.size(); i++)
+    {
+        swimApply(msg->memberList[i]);
+    }
+
+    switch (msg->msgType)
+    {
+    case PING:
+        swimSend(ACK, &msg->addr, &memberNode->addr);
+        break;
+    case ACK:
+        if (keyOfAddress(&msg->target) == probeTarget)
+        {
+            probeAcked = true;
+        }
+        break;
+    case PINGREQ:
+        swimSend(IPING, &msg->target, &msg->addr);
+        break;
+    case IPING:
+        swimSend(IACK, &msg->addr, &msg->target);
+        break;
+    case IACK:
+        swimSend(ACK, &msg->target, &msg->addr);
+        break;
+    default:
+        break;
+    }
+}
+
+/**
+ * FUNCTION NAME: swimSend
+ *
+ * DESCRIPTION: Send a SWIM message with the updates that were passed on the least so far
+ */
+void MP1Node::swimSend(MsgTypes t, Address *to, Address *target)
+{
+    createMessage(t, &outMsg);
+    outMsg.target = *target;
+
+    // Updates are kept ordered by the sends they have left, the freshest first
+    int n = min((int)swimUpdates.size(), par->SWIM_PIGGYBACK);
+    for (int i = 0; i < n; i++)
+    {
+        outMsg.memberList.push_back(swimUpdates[i].entry);
+        swimUpdates[i].sends--;
+    }
+    // Only the first n moved down by one, an insertion pass puts them back in place without
+    // the buffer stable_sort would take
+    for (unsigned int i = 1; i < swimUpdates.size(); i++)
+    {
+        for (unsigned int j = i; j > 0 && swimUpdates[j - 1].sends < swimUpdates[j].sends; j--)
+        {
+            swap(swimUpdates[j - 1], swimUpdates[j]);
+        }
+    }
+    while (!swimUpdates.empty() && swimUpdates.back().sends <= 0)
+    {
+        swimUpdates.pop_back();
+    }
+
+    sendMessage(&outMsg, to);
+}
+
+/**
+ * FUNCTION NAME: swimDisseminate
+ *
+ * DESCRIPTION: Queue an update about a member for piggybacking, replacing older news about it
+ */
+void MP1Node::swimDisseminate(int id, short port, long inc, SwimStatus status)
+{
+    SwimUpdate update;
+    update.entry = MemberListEntry(id, port, inc * 4 + status, par->getcurrtime());
+    update.sends = SWIM_RETRANSMIT * (int)ceil(log2(memberNode->memberList.size() + 1));
+
+    for (unsigned int i = 0; i < swimUpdates.size(); i++)
+    {
+        if (swimUpdates[i].entry.id == id && swimUpdates[i].entry.port == port)
+        {
+            swimUpdates.erase(swimUpdates.begin() + i);
+            break;
+        }
+    }
+    swimUpdates.insert(swimUpdates.begin(), update);
+}
+
+/**
+ * FUNCTION NAME: swimApply
+ *
+ * DESCRIPTION: Apply a piggybacked update. Higher incarnations win; at equal incarnation a
+ * 				suspicion overrides alive. A node that hears it is suspected or dead refutes it
+ * 				with a new incarnation
+ */
+void MP1Node::swimApply(MemberListEntry &update)
+{
+    long inc = update.heartbeat >> 2;
+    int status = update.heartbeat & 3;
+    unsigned long long key = MemberIndex::pack(update.id, update.port);
+    int pos = memberIndex.find(update.id, update.port);
+    vector<MemberListEntry> &list = memberNode->memberList;
+
+    if (key == keyOfAddress(&memberNode->addr))
+    {
+        if (status != SWIM_ALIVE && inc >= incarnation)
+        {
+            incarnation = inc + 1;
+            if (pos >= 0)
+            {
+                list[pos].heartbeat = incarnation;
+            }
+            swimDisseminate(update.id, update.port, incarnation, SWIM_ALIVE);
+        }
+        return;
+    }
+
+    if (status == SWIM_ALIVE)
+    {
+        if (pos < 0)
+        {
+            unordered_map<unsigned long long, long>::iterator dead = deadHeartbeat.find(key);
+            if (dead != deadHeartbeat.end() && inc <= dead->second)
+            {
+                return;
+            }
+            deadHeartbeat.erase(key);
+            addMember(MemberListEntry(update.id, update.port, inc, par->getcurrtime()));
+            Address added = addressOfKey(key);
+            log->logNodeAdd(&memberNode->addr, &added);
+            swimDisseminate(update.id, update.port, inc, SWIM_ALIVE);
+        }
+        else if (inc > list[pos].heartbeat)
+        {
+            list[pos].heartbeat = inc;
+            list[pos].timestamp = par->getcurrtime();
+            suspectSince[pos] = -1;
+            swimDisseminate(update.id, update.port, inc, SWIM_ALIVE);
+        }
+    }
+    else if (status == SWIM_SUSPECT)
+    {
+        if (pos >= 0 && (inc > list[pos].heartbeat || (inc == list[pos].heartbeat && suspectSince[pos] < 0)))
+        {
+            list[pos].heartbeat = inc;
+            suspectSince[pos] = par->getcurrtime();
+            swimDisseminate(update.id, update.port, inc, SWIM_SUSPECT);
+        }
+    }
+    else if (status == SWIM_CONFIRM)
+    {
+        if (pos >= 0 && inc >= list[pos].heartbeat)
+        {
+            Address dead = addressOfKey(key);
+            log->logNodeRemove(&memberNode->addr, &dead);
+            deadHeartbeat[key] = inc;
+            removeMember(pos, MEMBER_FAILED);
+            swimDisseminate(update.id, update.port, inc, SWIM_CONFIRM);
+        }
+    }
+}
+
+/**
+ * FUNCTION NAME: ringKeyOf
+ *
+ * DESCRIPTION: Ring position of a member as the key-value store hashes it, in the top bits,
+ * 				with the packed (id, port) below so members sharing a position are still ordered
+ */
+unsigned long long MP1Node::ringKeyOf(int id, short port)
+{
+    unsigned long long key = MemberIndex::pack(id, port);
+    Node node(addressOfKey(key));
+    return ((unsigned long long)node.nodeHashCode << 48) | key;
+}
+
+/**
+ * FUNCTION NAME: considerMember
+ *
+ * DESCRIPTION: Partial view: offer a member this node heard of. It is monitored if it is one of
+ * 				the RING_VIEW closest members on either side of this node on the ring, or the
+ * 				first member past one of the power of two distances, and kept in the passive
+ * 				view otherwise
+ */
+void MP1Node::considerMember(const MemberListEntry &entry)
+{
+    unsigned long long key = MemberIndex::pack(entry.id, entry.port);
+    if (key == keyOfAddress(&memberNode->addr) || memberIndex.find(entry.id, entry.port) >= 0)
+    {
+        return;
+    }
+    unordered_map<unsigned long long, long>::iterator dead = deadHeartbeat.find(key);
+    if (dead != deadHeartbeat.end())
+    {
+        if (entry.heartbeat <= dead->second)
+        {
+            return;
+        }
+        deadHeartbeat.erase(dead);
+    }
+
+    // Most candidates do not make it into the view, they never touch it
+    if (!keepsCandidate(key))
+    {
+        addPassive(entry);
+        return;
+    }
+    MemberListEntry candidate(entry);
+    candidate.timestamp = par->getcurrtime();
+    addMember(candidate);
+    trimActiveView();
+    if (memberIndex.find(entry.id, entry.port) < 0)
+    {
+        addPassive(entry);
+        return;
+    }
+
+    for (unsigned int i = 0; i < passiveView.size(); i++)
+    {
+        if (passiveView[i].id == entry.id && passiveView[i].port == entry.port)
+        {
+            passiveView[i] = passiveView.back();
+            passiveView.pop_back();
+            break;
+        }
+    }
+    Address added = addressOfKey(key);
+    log->logNodeAdd(&memberNode->addr, &added);
+}
+
+/**
+ * FUNCTION NAME: sortedView
+ *
+ * DESCRIPTION: Clockwise distance from this node and packed (id, port) of every other monitored
+ * 				member, in order of distance. Sorted again only after the view changed
+ */
+vector<pair<unsigned long long, unsigned long long> > &MP1Node::sortedView()
+{
+    vector<pair<unsigned long long, unsigned long long> > &byDistance = viewDistances;
+    if (!viewChanged)
+    {
+        return byDistance;
+    }
+    vector<MemberListEntry> &list = memberNode->memberList;
+    unsigned long long self = keyOfAddress(&memberNode->addr);
+    unsigned long long span = (unsigned long long)par->RING_POSITIONS << 48;
+    unsigned long long selfRing = ringKeyOf((int)(self >> 16), (short)(self & 0xffff));
+
+    byDistance.clear();
+    for (unsigned int i = 0; i < list.size(); i++)
+    {
+        unsigned long long key = MemberIndex::pack(list[i].id, list[i].port);
+        if (key != self)
+        {
+            byDistance.push_back(make_pair((ringKeyOf(list[i].id, list[i].port) + span - selfRing) % span, key));
+        }
+    }
+    sort(byDistance.begin(), byDistance.end());
+    viewChanged = false;
+    return byDistance;
+}
+
+/**
+ * FUNCTION NAME: keepsCandidate
+ *
+ * DESCRIPTION: Whether trimActiveView would keep the member key if it were added to the view:
+ * 				it would be one of the RING_VIEW closest on either side, or the first member past
+ * 				a power of two distance
+ */
+bool MP1Node::keepsCandidate(unsigned long long key)
+{
+    vector<pair<unsigned long long, unsigned long long> > &byDistance = sortedView();
+    int n = byDistance.size() + 1;
+    if (n <= 2 * par->RING_VIEW)
+    {
+        return true;
+    }
+    unsigned long long self = keyOfAddress(&memberNode->addr);
+    unsigned long long span = (unsigned long long)par->RING_POSITIONS << 48;
+    unsigned long long selfRing = ringKeyOf((int)(self >> 16), (short)(self & 0xffff));
+    unsigned long long distance = (ringKeyOf((int)(key >> 16), (short)(key & 0xffff)) + span - selfRing) % span;
+
+    // Its place among the members, counting itself
+    int rank = lower_bound(byDistance.begin(), byDistance.end(), make_pair(distance, key)) - byDistance.begin();
+    if (rank < par->RING_VIEW || rank >= n - par->RING_VIEW)
+    {
+        return true;
+    }
+    for (unsigned long long step = 1; step < (unsigned long long)par->RING_POSITIONS; step <<= 1)
+    {
+        int finger = lower_bound(byDistance.begin(), byDistance.end(), make_pair(step << 48, 0ULL)) - byDistance.begin();
+        if (finger == rank && distance >= (step << 48))
+        {
+            return true;
+        }
+    }
+    return false;
+}
+
+/**
+ * FUNCTION NAME: trimActiveView
+ *
+ * DESCRIPTION: Move every monitored member that is neither a ring neighbour nor a finger to the
+ * 				passive view. The view stays O(RING_VIEW + log2(RING_POSITIONS)) whatever the group size
+ */
+void MP1Node::trimActiveView()
+{
+    vector<MemberListEntry> &list = memberNode->memberList;
+    // Evictions below mark the view changed but leave this copy as it was sorted
+    vector<pair<unsigned long long, unsigned long long> > &byDistance = sortedView();
+    int n = byDistance.size();
+    if (n <= 2 * par->RING_VIEW)
+    {
+        return;
+    }
+
+    vector<bool> &keep = keepScratch;
+    keep.assign(n, false);
+    for (int i = 0; i < par->RING_VIEW; i++)
+    {
+        keep[i] = true;
+        keep[n - 1 - i] = true;
+    }
+    for (unsigned long long step = 1; step < (unsigned long long)par->RING_POSITIONS; step <<= 1)
+    {
+        int finger = lower_bound(byDistance.begin(), byDistance.end(), make_pair(step << 48, 0ULL)) - byDistance.begin();
+        if (finger < n)
+        {
+            keep[finger] = true;
+        }
+    }
+
+    for (int i = 0; i < n; i++)
+    {
+        if (!keep[i])
+        {
+            int pos = memberIndex.find((int)(byDistance[i].second >> 16), (short)(byDistance[i].second & 0xffff));
+            MemberListEntry evicted = list[pos];
+            removeMember(pos, MEMBER_LEFT);
+            addPassive(evicted);
+        }
+    }
+}
+
+/**
+ * FUNCTION NAME: addPassive
+ *
+ * DESCRIPTION: Remember a member that is not monitored. When the passive view is full the
+ * 				entry with the oldest news makes room, so members that stopped being heard of fade out
+ */
+void MP1Node::addPassive(const MemberListEntry &entry)
+{
+    if (MemberIndex::pack(entry.id, entry.port) == keyOfAddress(&memberNode->addr) || memberIndex.find(entry.id, entry.port) >= 0)
+    {
+        return;
+    }
+    int oldest = -1;
+    for (unsigned int i = 0; i < passiveView.size(); i++)
+    {
+        if (passiveView[i].id == entry.id && passiveView[i].port == entry.port)
+        {
+            if (entry.heartbeat > passiveView[i].heartbeat)
+            {
+                passiveView[i] = entry;
+            }
+            return;
+        }
+        if (oldest < 0 || passiveView[i].timestamp < passiveView[oldest].timestamp)
+        {
+            oldest = i;
+        }
+    }
+    if ((int)passiveView.size() < par->VIEW_PASSIVE)
+    {
+        passiveView.push_back(entry);
+    }
+    else if (oldest >= 0 && passiveView[oldest].timestamp < entry.timestamp)
+    {
+        passiveView[oldest] = entry;
+    }
+}
+
+/**
+ * FUNCTION NAME: promotePassive
+ *
+ * DESCRIPTION: Offer every passive member again, to take the place of monitored members that failed
+ */
+void MP1Node::promotePassive()
+{
+    vector<MemberListEntry> &candidates = entryScratch;
+    candidates.clear();
+    candidates.swap(passiveView);
+    viewHoles = false;
+    for (unsigned int i = 0; i < candidates.size(); i++)
+    {
+        considerMember(candidates[i]);
+    }
+}
+
+/**
+ * FUNCTION NAME: sampleMembers
+ *
+ * DESCRIPTION: Append up to n distinct random members, passive ones first
+ */
+void MP1Node::sampleMembers(vector<MemberListEntry> &out, int n)
+{
+    vector<MemberListEntry> &pool = entryScratch;
+    pool.assign(passiveView.begin(), passiveView.end());
+    shuffle(pool.begin(), pool.end(), rng);
+    if ((int)pool.size() < n)
+    {
+        unsigned long long self = keyOfAddress(&memberNode->addr);
+        for (unsigned int i = 0; i < memberNode->memberList.size(); i++)
+        {
+            if (MemberIndex::pack(memberNode->memberList[i].id, memberNode->memberList[i].port) != self)
+            {
+                pool.push_back(memberNode->memberList[i]);
+            }
+        }
+    }
+    for (int i = 0; i < n && i < (int)pool.size(); i++)
+    {
+        out.push_back(pool[i]);
+    }
+}
+
+/**
+ * FUNCTION NAME: sendShuffle
+ *
+ * DESCRIPTION: Send this node and SHUFFLE_LENGTH - 1 random members it knows to a random monitored member
+ */
+void MP1Node::sendShuffle()
+{
+    vector<MemberListEntry> &list = memberNode->memberList;
+    unsigned long long self = keyOfAddress(&memberNode->addr);
+    if (list.size() < 2)
+    {
+        return;
+    }
+    int peer = rng() % list.size();
+    if (MemberIndex::pack(list[peer].id, list[peer].port) == self)
+    {
+        peer = (peer + 1) % list.size();
+    }
+
+    createMessage(SHUFFLE, &outMsg);
+    outMsg.memberList.push_back(list[memberIndex.find((int)(self >> 16), (short)(self & 0xffff))]);
+    sampleMembers(outMsg.memberList, par->SHUFFLE_LENGTH - 1);
+
+    Address peerAddr = addressOfKey(MemberIndex::pack(list[peer].id, list[peer].port));
+    sendMessage(&outMsg, &peerAddr);
+}
+
+/**
+ * FUNCTION NAME: shuffleHandler
+ *
+ * DESCRIPTION: Take in the members of a view exchange, answering a SHUFFLE with a sample of our own
+ */
+void MP1Node::shuffleHandler(MessageHdr *msg)
+{
+    if (msg->msgType == SHUFFLE)
+    {
+        createMessage(SHUFFLEREP, &outMsg);
+        sampleMembers(outMsg.memberList, par->SHUFFLE_LENGTH);
+        sendMessage(&outMsg, &msg->addr);
+    }
+
+    deadHeartbeat.erase(keyOfAddress(&msg->addr));
+    for (unsigned int i = 0; i < msg->memberList.size(); i++)
+    {
+        considerMember(msg->memberList[i]);
+    }
+}
+
+/**
+ * FUNCTION NAME: sendMessage
+ *
+ * DESCRIPTION: Encode a message and send it to each of the count addresses at to. A member list
+ * 				too long for one frame of MAX_MSG_SIZE goes out in chunks, each one a complete
+ * 				message of the same type that the receiver merges on its own
+ */
+void MP1Node::sendMessage(MessageHdr *msg, Address *to, int count)
+{
+    int limit = par->MAX_MSG_SIZE - (int)sizeof(en_msg);
+    long now = par->getcurrtime();
+    vector<MemberListEntry> &list = msg->memberList;
+
+    encodeMessage(msg, now, wire);
+    if ((int)wire.size() < limit || list.size() <= 1)
+    {
+        for (int i = 0; i < count; i++)
+        {
+            emulNet->ENsend(&memberNode->addr, &to[i], wire.data(), wire.size());
+        }
+        return;
+    }
+
+    MessageHdr &chunk = chunkMsg;
+    chunk.msgType = msg->msgType;
+    chunk.addr = msg->addr;
+    chunk.target = msg->target;
+    // Entries per chunk, first guessed from the size of the whole message, then cut down until a chunk fits
+    size_t per = max((size_t)1, list.size() * limit / wire.size());
+    for (size_t start = 0; start < list.size(); )
+    {
+        size_t n = min(per, list.size() - start);
+        chunk.memberList.assign(list.begin() + start, list.begin() + start + n);
+        encodeMessage(&chunk, now, wire);
+        if ((int)wire.size() >= limit && n > 1)
+        {
+            per = n * 3 / 4;
+            continue;
+        }
+        for (int i = 0; i < count; i++)
+        {
+            emulNet->ENsend(&memberNode->addr, &to[i], wire.data(), wire.size());
+        }
+        start += n;
+    }
+}
+
+/**
+ * Zigzag varints: small magnitudes of either sign take few bytes
+ */
+static void putVarint(vector<char> &buf, long v)
+{
+    unsigned long u = ((unsigned long)v << 1) ^ (unsigned long)(v >> (8 * sizeof(long) - 1));
+    while (u >= 0x80)
+    {
+        buf.push_back((char)(u | 0x80));
+        u >>= 7;
+    }
+    buf.push_back((char)u);
+}
+
+static bool getVarint(char *&p, char *end, long &v)
+{
+    unsigned long u = 0;
+    for (int shift = 0; p < end && shift < (int)(8 * sizeof(long)); shift += 7)
+    {
+        unsigned char b = *p++;
+        u |= (unsigned long)(b & 0x7f) << shift;
+        if (!(b & 0x80))
+        {
+            v = (long)(u >> 1) ^ -(long)(u & 1);
+            return true;
+        }
+    }
+    return false;
+}
+
+/**
+ * FUNCTION NAME: encodeMessage
+ *
+ * DESCRIPTION: Write the wire form of a message into buf, see MessageHdr
+ */
+void MP1Node::encodeMessage(MessageHdr *msg, long now, vector<char> &buf)
+{
+    long prevId = 0, prevPort = 0;
+
+    buf.clear();
+    buf.push_back((char)msg->msgType);
+    buf.insert(buf.end(), msg->addr.addr, msg->addr.addr + sizeof(msg->addr.addr));
+    if (msg->msgType >= PING)
+    {
+        buf.insert(buf.end(), msg->target.addr, msg->target.addr + sizeof(msg->target.addr));
+    }
+    putVarint(buf, now);
+    putVarint(buf, msg->memberList.size());
+    for (unsigned int i = 0; i < msg->memberList.size(); i++)
+    {
+        MemberListEntry &e = msg->memberList[i];
+        putVarint(buf, e.id - prevId);
+        putVarint(buf, e.port - prevPort);
+        putVarint(buf, e.heartbeat);
+        putVarint(buf, now - e.timestamp);
+        prevId = e.id;
+        prevPort = e.port;
+    }
+}
+
+/**
+ * FUNCTION NAME: decodeMessage
+ *
+ * DESCRIPTION: Read a message from its wire form
+ *
+ * RETURNS:
+ * false if the bytes are not a complete message
+ */
+bool MP1Node::decodeMessage(char *data, int size, MessageHdr *msg)
+{
+    char *p = data, *end = data + size;
+    long now, count, id = 0, port = 0, delta, heartbeat, age;
+
+    if (size < 1 + (int)sizeof(msg->addr.addr) || (unsigned char)*p > IACK)
+    {
+        return false;
+    }
+    msg->msgType = (MsgTypes)*p++;
+    memcpy(msg->addr.addr, p, sizeof(msg->addr.addr));
+    p += sizeof(msg->addr.addr);
+    if (msg->msgType >= PING)
+    {
+        if (end - p < (int)sizeof(msg->target.addr))
+        {
+            return false;
+        }
+        memcpy(msg->target.addr, p, sizeof(msg->target.addr));
+        p += sizeof(msg->target.addr);
+    }
+
+    // Every entry takes at least 4 bytes, which bounds a bogus count
+    if (!getVarint(p, end, now) || !getVarint(p, end, count) || count < 0 || count > (end - p) / 4)
+    {
+        return false;
+    }
+    msg->memberList.clear();
+    msg->memberList.reserve(count);
+    for (long i = 0; i < count; i++)
+    {
+        if (!getVarint(p, end, delta))
+        {
+            return false;
+        }
+        id += delta;
+        if (!getVarint(p, end, delta) || !getVarint(p, end, heartbeat) || !getVarint(p, end, age))
+        {
+            return false;
+        }
+        port += delta;
+        msg->memberList.push_back(MemberListEntry((int)id, (short)port, heartbeat, now - age));
+    }
+    return p == end;
+}
+
 /**
  * FUNCTION NAME: getAddressFromId
  *
  * DESCRIPTION: Convert id and port to an address
  */
-Address *MP1Node::getAddressFromId(int id, short port)
+Address MP1Node::getAddressFromId(int id, short port)
 {
-    char addr[6];
-    *(int *)&addr[0] = id;
-    *(short *)&addr[4] = port;
-    Address *a = new Address();
-    memcpy((char *)&a->addr[0], (char *)&addr[0], sizeof(addr));
+    Address a;
+    memcpy((char *)&a.addr[0], (char *)&id, sizeof(int));
+    memcpy((char *)&a.addr[4], (char *)&port, sizeof(short));
     return a;
 }
 
@@ -437,14 +1365,18 @@ int MP1Node::isNullAddress(Address *addr)
 /**
  * FUNCTION NAME: getJoinAddress
  *
- * DESCRIPTION: Returns the Address of the coordinator
+ * DESCRIPTION: Returns the Address of the introducer to send the next JOINREQ to
  */
 Address MP1Node::getJoinAddress()
 {
     Address joinaddr;
+    int id;
+    memcpy((char *)&id, (char *)&memberNode->addr.addr[0], sizeof(int));
 
+    // Introducers 2.. join through the first one, every other node starts at the introducer its id
+    // picks, which spreads the joins, and moves on to the next one each time a JOINREQ goes unanswered
     memset(&joinaddr, 0, sizeof(Address));
-    *(int *)(&joinaddr.addr) = 1;
+    *(int *)(&joinaddr.addr) = id <= par->INTRODUCERS ? 1 : 1 + (id + joinAttempts) % par->INTRODUCERS;
     *(short *)(&joinaddr.addr[4]) = 0;
 
     return joinaddr;
@@ -462,9 +1394,137 @@ void MP1Node::initMemberListTable(Member *memberNode)
     short port;
     memcpy((char *)&id, (char *)&memberNode->addr.addr[0], sizeof(int));
     memcpy((char *)&port, (char *)&memberNode->addr.addr[4], sizeof(short));
-    // MemberListEntry entry(id, port, memberNode->heartbeat, par->getcurrtime());
-    MemberListEntry entry(id, port);
+    // Whatever the feed held is gone with the table
+    memberNode->membershipEvents.clear();
+    memberNode->membershipEpoch++;
+    memberIndex.clear();
+    viewChanged = true;
+    entryVersion.clear();
+    suspectSince.clear();
+    arrivals.clear();
+    addMember(MemberListEntry(id, port));
+}
+
+/**
+ * FUNCTION NAME: findMember
+ *
+ * DESCRIPTION: Entry of (id, port) in the membership list, NULL if it is not there
+ */
+MemberListEntry *MP1Node::findMember(int id, short port)
+{
+    int pos = memberIndex.find(id, port);
+    return pos < 0 ? NULL : &memberNode->memberList[pos];
+}
+
+/**
+ * FUNCTION NAME: addMember
+ *
+ * DESCRIPTION: Append an entry to the membership list unless its (id, port) is already there
+ *
+ * RETURNS:
+ * true if the entry was added
+ */
+bool MP1Node::addMember(const MemberListEntry &entry)
+{
+    if (memberIndex.find(entry.id, entry.port) >= 0)
+    {
+        return false;
+    }
+    memberIndex.set(entry.id, entry.port, memberNode->memberList.size());
+    viewChanged = true;
     memberNode->memberList.push_back(entry);
+    entryVersion.push_back(++version);
+    suspectSince.push_back(-1);
+    arrivals.push_back(PhiDetector());
+    publishChange(MEMBER_JOINED, entry.id, entry.port);
+
+    // A new member gets gossip somewhere in the rest of the current order, not only once it runs
+    // out, or a node that just joined would hear from its peers too seldom and time them all out
+    unsigned long long key = MemberIndex::pack(entry.id, entry.port);
+    if (gossipNext < gossipOrder.size() && key != keyOfAddress(&memberNode->addr))
+    {
+        gossipOrder.insert(gossipOrder.begin() + gossipNext + rng() % (gossipOrder.size() - gossipNext + 1), key);
+    }
+    return true;
+}
+
+/**
+ * FUNCTION NAME: removeMember
+ *
+ * DESCRIPTION: Remove the entry at pos by moving the last entry into its place
+ */
+void MP1Node::removeMember(int pos, MembershipChange change)
+{
+    vector<MemberListEntry> &list = memberNode->memberList;
+    int id = list[pos].id;
+    short port = list[pos].port;
+    memberIndex.erase(id, port);
+    viewChanged = true;
+    publishChange(change, id, port);
+    if (pos != (int)list.size() - 1)
+    {
+        list[pos] = list.back();
+        entryVersion[pos] = entryVersion.back();
+        suspectSince[pos] = suspectSince.back();
+        arrivals[pos] = arrivals.back();
+        memberIndex.set(list[pos].id, list[pos].port, pos);
+    }
+    list.pop_back();
+    entryVersion.pop_back();
+    suspectSince.pop_back();
+    arrivals.pop_back();
+}
+
+/**
+ * FUNCTION NAME: publishChange
+ *
+ * DESCRIPTION: Bump the membership epoch and append the change to the feed of the KV store.
+ * 				A feed longer than the table is dropped, rebuilding the ring costs less than replaying it.
+ * 				The epoch only ever grows. Candidates the partial view would evict right away are
+ * 				turned down by keepsCandidate before they are added, so they publish nothing
+ */
+void MP1Node::publishChange(MembershipChange change, int id, short port)
+{
+    vector<MembershipEvent> &events = memberNode->membershipEvents;
+    if (events.size() > memberNode->memberList.size())
+    {
+        events.clear();
+    }
+    events.push_back(MembershipEvent(++memberNode->membershipEpoch, change, id, port));
+}
+
+/**
+ * FUNCTION NAME: touchMember
+ *
+ * DESCRIPTION: Record a change to an entry, so the next delta gossip carries it
+ */
+void MP1Node::touchMember(MemberListEntry *entry)
+{
+    entryVersion[entry - &memberNode->memberList[0]] = ++version;
+}
+
+/**
+ * FUNCTION NAME: heardFrom
+ *
+ * DESCRIPTION: Record a fresh heartbeat of an entry: its inter-arrival time feeds the failure
+ * 				detector, and the change goes out with the next delta gossip
+ */
+void MP1Node::heardFrom(MemberListEntry *entry)
+{
+    int pos = entry - &memberNode->memberList[0];
+    arrivals[pos].arrival(par->getcurrtime() - entry->timestamp);
+    entry->timestamp = par->getcurrtime();
+    touchMember(entry);
+}
+
+/**
+ * FUNCTION NAME: phiOf
+ *
+ * DESCRIPTION: Suspicion level of the entry at pos, 0 right after a heartbeat
+ */
+double MP1Node::phiOf(int pos)
+{
+    return arrivals[pos].phi(par->getcurrtime() - memberNode->memberList[pos].timestamp);
 }
 
 /**
@@ -14,13 +14,20 @@
 #include "Member.h"
 #include "EmulNet.h"
 #include "Queue.h"
+#include "MemberIndex.h"
+#include "PhiDetector.h"
+#include "Node.h"
+#include <random>
 
 /**
  * Macros
  */
-#define TREMOVE 20
-#define TFAIL 5
 #define GOSSIP_FANOUT_VALUE 3
+// Time units to wait for a JOINREP before asking the next introducer
+#define JOIN_RETRY_TIMEOUT 10
+// SWIM: time units to wait for a direct ack, and how many times each update is passed on per log2 of the group size
+#define SWIM_ACK_TIMEOUT 2
+#define SWIM_RETRANSMIT 3
 
 /*
  * Note: You can change/add any functions in MP1Node.{h,cpp}
@@ -33,19 +40,56 @@ enum MsgTypes{
     JOINREQ,
     JOINREP,
     GOSSIP,
+    // Partial view: view exchange and its reply, and the answer to gossip from a member that does not monitor the sender
+    SHUFFLE,
+    SHUFFLEREP,
+    HEARTBEAT,
+    // SWIM probes: direct ping and ack, ping-req to a proxy, and the proxy's ping and the ack it gets back
+    PING,
+    ACK,
+    PINGREQ,
+    IPING,
+    IACK,
+};
+
+/**
+ * SWIM status of a member, carried in the low bits of the heartbeat of an update
+ */
+enum SwimStatus{
+    SWIM_ALIVE,
+    SWIM_SUSPECT,
+    SWIM_CONFIRM,
 };
 
 /**
  * STRUCT NAME: MessageHdr
  *
- * DESCRIPTION: Header and content of a message
+ * DESCRIPTION: Header and content of a message. This is the in-memory form, on the wire
+ * 				messages are encoded by encodeMessage:
+ * 				type (1 byte), sender address (6 bytes), sender time, entry count, then per entry
+ * 				id and port as deltas from the previous entry, heartbeat, and the age of the
+ * 				timestamp at the sender time. Every number after the address is a zigzag varint.
+ * 				SWIM messages have the target address right after the sender address
  */
 typedef struct MessageHdr {
 	enum MsgTypes msgType;
 	Address addr;
+	// SWIM: member probed on behalf of someone, or that someone, see swimHandler
+	Address target;
 	vector<MemberListEntry> memberList;
 }MessageHdr;
 
+/**
+ * STRUCT NAME: SwimUpdate
+ *
+ * DESCRIPTION: Membership update waiting to be piggybacked, heartbeat is incarnation * 4 + status
+ */
+typedef struct SwimUpdate {
+	MemberListEntry entry;
+	// Messages it still has to ride on
+	int sends;
+}SwimUpdate;
+
 /**
  * CLASS NAME: MP1Node
  *
@@ -58,6 +102,58 @@ private:
 	Params *par;
 	Member *memberNode;
 	char NULLADDR[6];
+	// Source of every random choice of the node, seeded from SEED and its id so that runs
+	// repeat whichever thread drives the node
+	minstd_rand rng;
+	// Encoding buffer, reused by every send
+	vector<char> wire;
+	// Message decoded last, message being built, and chunk of it being sent. Kept across
+	// ticks so their member lists stop allocating once grown
+	MessageHdr inMsg;
+	MessageHdr outMsg;
+	MessageHdr chunkMsg;
+	// Position of every entry of memberNode->memberList, by (id, port)
+	MemberIndex memberIndex;
+	// Delta gossip: version of the last change to each entry, parallel to memberList, and
+	// the version at the previous round
+	vector<long> entryVersion;
+	long version;
+	long lastRoundVersion;
+	long gossipRound;
+	// Gossip peers in shuffled order, and the next one to use
+	vector<unsigned long long> gossipOrder;
+	unsigned int gossipNext;
+	// Addresses gossiped to in the current round
+	vector<Address> gossipTargets;
+	// Unanswered JOINREQs so far, and when the last one was sent
+	int joinAttempts;
+	long joinSentAt;
+	// Heartbeat inter-arrival history of each entry, parallel to memberList
+	vector<PhiDetector> arrivals;
+	// Last heartbeat (SWIM: incarnation) of removed members, only news past it brings them back
+	unordered_map<unsigned long long, long> deadHeartbeat;
+	// SWIM: time each member became suspect, -1 if alive, parallel to memberList
+	vector<long> suspectSince;
+	long incarnation;
+	vector<SwimUpdate> swimUpdates;
+	// Probe targets in shuffled order, and the probe of the current period
+	vector<unsigned long long> probeOrder;
+	unsigned int probeNext;
+	unsigned long long probeTarget;
+	bool probeAcked;
+	// Candidate proxies of an unacked probe, reused by every period
+	vector<unsigned long long> proxyScratch;
+	// Partial view: members known but not monitored, refreshed by shuffles, and whether a
+	// failure left the monitored view short
+	vector<MemberListEntry> passiveView;
+	bool viewHoles;
+	// Partial view: clockwise ring distance and packed (id, port) of every other monitored member,
+	// sorted, and whether the view changed since they were sorted
+	vector<pair<unsigned long long, unsigned long long> > viewDistances;
+	bool viewChanged;
+	// Scratch space of the partial view, reused by every call
+	vector<bool> keepScratch;
+	vector<MemberListEntry> entryScratch;
 
 public:
 	MP1Node(Member *, Params *, EmulNet *, Log *, Address *);
@@ -78,13 +174,39 @@ public:
 	Address getJoinAddress();
 	void initMemberListTable(Member *memberNode);
 	void printAddress(Address *addr);
-	Address *getAddressFromId(int id, short port);
+	Address getAddressFromId(int id, short port);
 	virtual ~MP1Node();
 	void addNewNode(MessageHdr* msg);
-	MessageHdr* createMessage(MsgTypes t);
+	void createMessage(MsgTypes t, MessageHdr *msg, long since = -1);
 	void gossipHandler(MessageHdr *msg);
 	void removeFailedNode();
 	void sendGossips();
+	unsigned long long nextPeer(vector<unsigned long long> &order, unsigned int &next);
+	void sendMessage(MessageHdr *msg, Address *to, int count = 1);
+	MemberListEntry *findMember(int id, short port);
+	bool addMember(const MemberListEntry &entry);
+	void removeMember(int pos, MembershipChange change);
+	void publishChange(MembershipChange change, int id, short port);
+	void touchMember(MemberListEntry *entry);
+	void heardFrom(MemberListEntry *entry);
+	double phiOf(int pos);
+	void considerMember(const MemberListEntry &entry);
+	vector<pair<unsigned long long, unsigned long long> > &sortedView();
+	bool keepsCandidate(unsigned long long key);
+	void trimActiveView();
+	void addPassive(const MemberListEntry &entry);
+	void sampleMembers(vector<MemberListEntry> &out, int n);
+	void promotePassive();
+	void sendShuffle();
+	void shuffleHandler(MessageHdr *msg);
+	static unsigned long long ringKeyOf(int id, short port);
+	void swimLoop();
+	void swimHandler(MessageHdr *msg);
+	void swimSend(MsgTypes t, Address *to, Address *target);
+	void swimApply(MemberListEntry &update);
+	void swimDisseminate(int id, short port, long inc, SwimStatus status);
+	static void encodeMessage(MessageHdr *msg, long now, vector<char> &buf);
+	static bool decodeMessage(char *data, int size, MessageHdr *msg);
 };
 
 #endif /* _MP1NODE_H_ */
\ No newline at end of file
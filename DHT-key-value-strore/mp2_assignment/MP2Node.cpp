@@ -23,6 +23,8 @@ MP2Node::MP2Node(Member *memberNode, Params *par, EmulNet *emulNet, Log *log, Ad
 	this->log = log;
 	ht = new HashTable();
 	this->memberNode->addr = *address;
+	this->ringEpoch = 0;
+	this->merkle = MerkleTree(par->RING_POSITIONS);
 }
 
 /**
@@ -38,7 +40,17 @@ struct less_than_key
 {
 	inline bool operator()(const Node &node1, const Node &node2)
 	{
-		return (node1.nodeHashCode < node2.nodeHashCode);
+		// Nodes sharing a position are ordered by id and port, the same on every node
+		if (node1.nodeHashCode != node2.nodeHashCode)
+		{
+			return (node1.nodeHashCode < node2.nodeHashCode);
+		}
+		int id1 = *(int *)&node1.nodeAddress.addr[0], id2 = *(int *)&node2.nodeAddress.addr[0];
+		if (id1 != id2)
+		{
+			return id1 < id2;
+		}
+		return *(short *)&node1.nodeAddress.addr[4] < *(short *)&node2.nodeAddress.addr[4];
 	}
 };
 
@@ -46,57 +58,108 @@ struct less_than_key
  * FUNCTION NAME: updateRing
  *
  * DESCRIPTION: This function does the following:
- * 				1) Gets the current membership list from the Membership Protocol (MP1Node)
- * 				   The membership list is returned as a vector of Nodes. See Node class in Node.h
- * 				2) Constructs the ring based on the membership list
- * 				3) Calls the Stabilization Protocol
+ * 				1) Takes the changes the Membership Protocol (MP1Node) published since the last call
+ * 				   Nothing is done at all when the membership epoch has not moved
+ * 				2) Applies them to the ring, or rebuilds the ring from the membership list when
+ * 				   the feed has a gap
+ * 				3) Calls the Stabilization Protocol if the replicas of some position changed
  */
 void MP2Node::updateRing()
 {
-	/*
-	 * Implement this. Parts of it are already implemented
-	 */
-	vector<Node> curMemList;
-	bool change = false;
+	vector<MembershipEvent> &events = memberNode->membershipEvents;
 
-	/*
-	 *  Step 1. Get the current membership list from Membership Protocol / MP1
-	 */
-	curMemList = getMembershipList();
+	if (memberNode->membershipEpoch == ringEpoch)
+	{
+		sendDeferred();
+		antiEntropy();
+		return;
+	}
 
 	/*
-	 * Step 2: Construct the ring
+	 * Step 1 and 2: Bring the ring up to the current epoch
 	 */
-	// Sort the list based on the hashCode
-	sort(curMemList.begin(), curMemList.end(), less_than_key());
-
-	/* Check if ring has changed */
-	if (ring.size() != curMemList.size())
+	if (!events.empty() && events.front().epoch == ringEpoch + 1)
 	{
-		change = true;
-		ring = vector<Node>(curMemList);
+		for (uint i = 0; i < events.size(); i++)
+		{
+			applyChange(events[i]);
+		}
 	}
 	else
 	{
-		for (uint i = 0; i < ring.size(); i++)
+		vector<Node> curMemList = getMembershipList();
+		// Sort the list based on the hashCode
+		sort(curMemList.begin(), curMemList.end(), less_than_key());
+		ring.swap(curMemList);
+	}
+	events.clear();
+	ringEpoch = memberNode->membershipEpoch;
+
+	/* Check if ring has changed: a member that joined and left again since the last call
+	 * changes nothing, so only the replica tables before and after are compared */
+	oldTokens.swap(tokens);
+	oldReplicaTable.swap(replicaTable);
+	buildReplicaTable();
+	bool change = tokens != oldTokens;
+	for (uint i = 0; !change && i < replicaTable.size(); i++)
+	{
+		change = !(replicaTable[i].nodeAddress == oldReplicaTable[i].nodeAddress);
+	}
+
+	// Stabilization messages for nodes that left the ring would hold up the live ones forever
+	map<string, pair<Address, vector<string> > >::iterator pending = deferred.begin();
+	while (pending != deferred.end())
+	{
+		Node destination(pending->second.first);
+		if (inRing(destination))
 		{
-			if (ring[i].nodeHashCode != curMemList[i].nodeHashCode)
-			{
-				change = true;
-				ring = vector<Node>(curMemList);
-				break;
-			}
+			pending++;
+		}
+		else
+		{
+			deferred.erase(pending++);
 		}
 	}
 
 	/*
 	 * Step 3: Run the stabilization protocol IF REQUIRED
 	 */
-	// Run stabilization protocol if the hash table size is greater than zero and if there has been a changed in the ring
 	if (change)
 	{
 		stabilizationProtocol();
 	}
+	sendDeferred();
+	antiEntropy();
+}
+
+/**
+ * FUNCTION NAME: applyChange
+ *
+ * DESCRIPTION: Insert or remove the node of one membership change at its place in the ring
+ *
+ * RETURNS:
+ * true if the ring changed
+ */
+bool MP2Node::applyChange(MembershipEvent &event)
+{
+	Address address;
+	memcpy(&address.addr[0], &event.id, sizeof(int));
+	memcpy(&address.addr[4], &event.port, sizeof(short));
+	Node node(address);
+
+	vector<Node>::iterator it = lower_bound(ring.begin(), ring.end(), node, less_than_key());
+	bool present = it != ring.end() && it->nodeAddress == address;
+	if (event.change == MEMBER_JOINED && !present)
+	{
+		ring.insert(it, node);
+		return true;
+	}
+	if (event.change != MEMBER_JOINED && present)
+	{
+		ring.erase(it);
+		return true;
+	}
+	return false;
 }
 
 /**
@@ -134,11 +197,11 @@ vector<Node> MP2Node::getMembershipList()
  * RETURNS:
  * size_t position on the ring
  */
-size_t MP2Node::hashFunction(string key)
+size_t MP2Node::hashFunction(const string &key)
 {
 	std::hash<string> hashFunc;
 	size_t ret = hashFunc(key);
-	return ret % RING_SIZE;
+	return ret % par->RING_POSITIONS;
 }
 
 /**
@@ -152,16 +215,10 @@ size_t MP2Node::hashFunction(string key)
  */
 void MP2Node::clientCreate(string key, string value)
 {
-	/* Find replicas */
-	vector<Node> replicas = findNodes(key);
-
 	/* Construct and send message */
 	g_transID++;
-	for (uint i = 0; i < replicas.size(); i++)
-	{
-		Message message(g_transID, memberNode->addr, CREATE, key, value, i == 0 ? PRIMARY : i == 1 ? SECONDARY : TERTIARY); //TODO: pass replica type
-		emulNet->ENsend(&memberNode->addr, &replicas[i].nodeAddress, message.toString());
-	}
+	Message message(g_transID, memberNode->addr, CREATE, key, value, PRIMARY);
+	sendToReplicas(message);
 
 	expectedReplies.push_back(vector<int>{g_transID, par->globaltime, 0, 0, CREATE});
 	expectedRepliesStrings.push_back(vector<string>{key, value});
@@ -178,16 +235,10 @@ void MP2Node::clientCreate(string key, string value)
  */
 void MP2Node::clientRead(string key)
 {
-	/* Find replicas */
-	vector<Node> replicas = findNodes(key);
-
 	/* Construct and send message */
 	g_transID++;
-	for (uint i = 0; i < replicas.size(); i++)
-	{
-		Message message(g_transID, memberNode->addr, READ, key); //TODO: pass replica type
-		emulNet->ENsend(&memberNode->addr, &replicas[i].nodeAddress, message.toString());
-	}
+	Message message(g_transID, memberNode->addr, READ, key);
+	sendToReplicas(message);
 
 	expectedReplies.push_back(vector<int>{g_transID, par->globaltime, 0, 0, READ});
 	expectedRepliesStrings.push_back(vector<string>{key});
@@ -204,16 +255,10 @@ void MP2Node::clientRead(string key)
  */
 void MP2Node::clientUpdate(string key, string value)
 {
-	/* Find replicas */
-	vector<Node> replicas = findNodes(key);
-
 	/* Construct and send message */
 	g_transID++;
-	for (uint i = 0; i < replicas.size(); i++)
-	{
-		Message message(g_transID, memberNode->addr, UPDATE, key, value); //TODO: pass replica type
-		emulNet->ENsend(&memberNode->addr, &replicas[i].nodeAddress, message.toString());
-	}
+	Message message(g_transID, memberNode->addr, UPDATE, key, value, PRIMARY);
+	sendToReplicas(message);
 
 	expectedReplies.push_back(vector<int>{g_transID, par->globaltime, 0, 0, UPDATE});
 	expectedRepliesStrings.push_back(vector<string>{key, value});
@@ -231,16 +276,10 @@ void MP2Node::clientUpdate(string key, string value)
 void MP2Node::clientDelete(string key)
 {
 	/* NOTE: Fails when ring has less than 3 members? */
-	/* Find replicas */
-	vector<Node> replicas = findNodes(key);
-
 	/* Construct and send message */
 	g_transID++;
-	for (uint i = 0; i < replicas.size(); i++)
-	{
-		Message message(g_transID, memberNode->addr, DELETE, key); //TODO: pass replica type
-		emulNet->ENsend(&memberNode->addr, &replicas[i].nodeAddress, message.toString());
-	}
+	Message message(g_transID, memberNode->addr, DELETE, key);
+	sendToReplicas(message);
 
 	expectedReplies.push_back(vector<int>{g_transID, par->globaltime, 0, 0, DELETE});
 	expectedRepliesStrings.push_back(vector<string>{key});
@@ -257,7 +296,9 @@ void MP2Node::clientDelete(string key)
 bool MP2Node::createKeyValue(string key, string value, ReplicaType replica)
 {
 	/* NOTE: The `create` function never returns false */
+	string before = ht->read(key);
 	bool ret = ht->create(key, value);
+	track(key, before);
 	return ret;
 }
 
@@ -286,7 +327,9 @@ string MP2Node::readKey(string key)
 bool MP2Node::updateKeyValue(string key, string value, ReplicaType replica)
 {
 	/* NOTE: Haven't used replica here */
+	string before = ht->read(key);
 	bool ret = ht->update(key, value);
+	track(key, before);
 	return ret;
 }
 
@@ -300,10 +343,53 @@ bool MP2Node::updateKeyValue(string key, string value, ReplicaType replica)
  */
 bool MP2Node::deletekey(string key)
 {
+	string before = ht->read(key);
 	bool ret = ht->deleteKey(key);
+	track(key, before);
+	if (ret)
+	{
+		tombstones[key] = par->getcurrtime();
+	}
 	return ret;
 }
 
+/**
+ * FUNCTION NAME: track
+ *
+ * DESCRIPTION: Bring the hash tree and the keys by position up to date after key changed from
+ * 				value before, empty if it was not there
+ */
+void MP2Node::track(const string &key, const string &before)
+{
+	size_t pos = hashFunction(key);
+	string after = ht->read(key);
+	if (before == after)
+	{
+		return;
+	}
+	vector<string> &keys = positionKeys[pos];
+	if (!before.empty())
+	{
+		merkle.toggle(pos, key, before);
+	}
+	else
+	{
+		keys.push_back(key);
+	}
+	if (!after.empty())
+	{
+		merkle.toggle(pos, key, after);
+	}
+	else
+	{
+		keys.erase(find(keys.begin(), keys.end(), key));
+		if (keys.empty())
+		{
+			positionKeys.erase(pos);
+		}
+	}
+}
+
 /**
  * FUNCTION NAME: checkMessages
  *
@@ -341,11 +427,14 @@ void MP2Node::checkMessages()
 		 */
 		Message msg(message);
 
-		/* Find replicas */
-		vector<Node> replicas = findNodes(msg.key);
-
 		if (msg.type == CREATE)
 		{
+			// A client create overrides a delete, a copy handed over before it does not
+			if (msg.transID == STABILIZE_TRANSID && tombstones.count(msg.key))
+			{
+				continue;
+			}
+			tombstones.erase(msg.key);
 			bool ret = createKeyValue(msg.key, msg.value, msg.replica);
 			if (ret)
 			{
@@ -400,6 +489,20 @@ void MP2Node::checkMessages()
 			Message sendMsg(msg.transID, memberNode->addr, REPLY, ret);
 			emulNet->ENsend(&memberNode->addr, &msg.fromAddr, sendMsg.toString());
 		}
+		else if (msg.type == FORWARD)
+		{
+			// Replicas answer the coordinator named in the forwarded request directly
+			Message request(msg.value);
+			sendToReplicas(request);
+		}
+		else if (msg.type == MERKLE)
+		{
+			merkleHandler(msg);
+		}
+		else if (msg.type == SYNC)
+		{
+			syncHandler(msg);
+		}
 		else if (msg.type == REPLY)
 		{
 			for (uint i = 0; i < expectedReplies.size(); i++)
@@ -414,7 +517,8 @@ void MP2Node::checkMessages()
 					{
 						expectedReplies[i][3]++;
 					}
-					if (expectedReplies[i][2] >= 2)
+					// Done once W replicas acked, or once too many failed for W to be left
+					if (expectedReplies[i][2] >= par->WRITE_QUORUM)
 					{
 						if (expectedReplies[i][4] == CREATE)
 						{
@@ -432,7 +536,7 @@ void MP2Node::checkMessages()
 						expectedRepliesStrings.erase(expectedRepliesStrings.begin() + i);
 						break;
 					}
-					else if (expectedReplies[i][3] >= 2)
+					else if (expectedReplies[i][3] > par->REPLICAS - par->WRITE_QUORUM)
 					{
 						if (expectedReplies[i][4] == CREATE)
 						{
@@ -468,13 +572,13 @@ void MP2Node::checkMessages()
 					{
 						expectedReplies[i][2]++;
 					}
-					if (expectedReplies[i][2] >= 2)
+					if (expectedReplies[i][2] >= par->READ_QUORUM)
 					{
 						log->logReadSuccess(&memberNode->addr, true, msg.transID, expectedRepliesStrings[i][0], msg.value);
 						expectedReplies.erase(expectedReplies.begin() + i);
 						expectedRepliesStrings.erase(expectedRepliesStrings.begin() + i);
 					}
-					else if (expectedReplies[i][3] >= 2)
+					else if (expectedReplies[i][3] > par->REPLICAS - par->READ_QUORUM)
 					{
 						log->logReadFail(&memberNode->addr, true, msg.transID, expectedRepliesStrings[i][0]);
 						expectedReplies.erase(expectedReplies.begin() + i);
@@ -485,10 +589,19 @@ void MP2Node::checkMessages()
 		}
 	}
 
+	/* All queued buffers are consumed, give their frames back to EmulNet */
+	emulNet->ENrelease(&memberNode->addr);
+
 	/* Check for old expecting messages and mark as failed */
+	// Over a partial view a request may take up to log2(RING_POSITIONS) forwards to reach its replicas
+	int timeout = par->QUORUM_TIMEOUT;
+	if (par->MEMBERSHIP == PARTIAL_MEMBERSHIP)
+	{
+		timeout += (int)ceil(log2(par->RING_POSITIONS));
+	}
 	for (int i = expectedReplies.size() - 1; i >= 0; i--)
 	{
-		if (par->globaltime - expectedReplies[i][1] > 3)
+		if (par->globaltime - expectedReplies[i][1] > timeout)
 		{
 			if (expectedReplies[i][4] == CREATE)
 			{
@@ -512,42 +625,267 @@ void MP2Node::checkMessages()
 	}
 }
 
+/**
+ * FUNCTION NAME: tokenOf
+ *
+ * DESCRIPTION: Position of virtual node vnode of node on the ring. The first one is the hash code
+ * 				of the node, so a ring with one position per node is the same as without vnodes
+ */
+size_t MP2Node::tokenOf(Node &node, int vnode)
+{
+	if (0 == vnode)
+	{
+		return node.nodeHashCode;
+	}
+	std::hash<string> hashFunc;
+	string seed(node.nodeAddress.addr, sizeof(node.nodeAddress.addr));
+	seed += "#" + to_string(vnode);
+	return hashFunc(seed) % par->RING_POSITIONS;
+}
+
+/**
+ * FUNCTION NAME: buildReplicaTable
+ *
+ * DESCRIPTION: Lay out the VNODES positions of every node and the replicas of the keys each one
+ * 				owns. The replicas are the owner and the next distinct nodes clockwise, later
+ * 				positions of a node already picked are skipped. A ring of fewer than REPLICAS
+ * 				nodes cannot place any key
+ */
+void MP2Node::buildReplicaTable()
+{
+	size_t n = ring.size();
+	tokens.clear();
+	replicaTable.clear();
+	size_t replicas = par->REPLICAS;
+	if (n < replicas)
+	{
+		return;
+	}
+
+	// Every position with the ring index of its node, nodes sharing a position in ring order
+	vector<pair<size_t, size_t> > vnodes;
+	for (size_t i = 0; i < n; i++)
+	{
+		for (int v = 0; v < par->VNODES; v++)
+		{
+			vnodes.push_back(make_pair(tokenOf(ring[i], v), i));
+		}
+	}
+	sort(vnodes.begin(), vnodes.end());
+
+	size_t t = vnodes.size();
+	vector<size_t> picked(replicas);
+	for (size_t k = 0; k < t; k++)
+	{
+		tokens.push_back(vnodes[k].first);
+		size_t count = 0;
+		for (size_t step = 0; count < replicas; step++)
+		{
+			size_t node = vnodes[(k + step) % t].second;
+			if (find(picked.begin(), picked.begin() + count, node) == picked.begin() + count)
+			{
+				picked[count++] = node;
+				replicaTable.push_back(ring[node]);
+			}
+		}
+	}
+}
+
+/**
+ * FUNCTION NAME: replicasIn
+ *
+ * DESCRIPTION: The replicas of position pos in the replica table table over positions tokens.
+ * 				Its owner is the first node at or after pos, and the first node of the ring past
+ * 				the last one
+ */
+ReplicaView MP2Node::replicasIn(vector<size_t> &tokens, vector<Node> &table, size_t pos)
+{
+	if (tokens.empty())
+	{
+		return ReplicaView();
+	}
+	size_t owner = lower_bound(tokens.begin(), tokens.end(), pos) - tokens.begin();
+	if (owner == tokens.size())
+	{
+		owner = 0;
+	}
+	return ReplicaView(&table[owner * (table.size() / tokens.size())], table.size() / tokens.size());
+}
+
+/**
+ * FUNCTION NAME: replicasOf
+ *
+ * DESCRIPTION: The replicas of position pos on the current ring
+ */
+ReplicaView MP2Node::replicasOf(size_t pos)
+{
+	return replicasIn(tokens, replicaTable, pos);
+}
+
+/**
+ * FUNCTION NAME: holds
+ *
+ * DESCRIPTION: Whether node is one of replicas
+ */
+bool MP2Node::holds(ReplicaView &replicas, Node &node)
+{
+	for (size_t i = 0; i < replicas.size(); i++)
+	{
+		if (replicas[i].nodeAddress == node.nodeAddress)
+		{
+			return true;
+		}
+	}
+	return false;
+}
+
+/**
+ * FUNCTION NAME: inRing
+ *
+ * DESCRIPTION: Whether node is on the current ring
+ */
+bool MP2Node::inRing(Node &node)
+{
+	vector<Node>::iterator it = lower_bound(ring.begin(), ring.end(), node, less_than_key());
+	return it != ring.end() && it->nodeAddress == node.nodeAddress;
+}
+
+/**
+ * FUNCTION NAME: keyCount
+ *
+ * DESCRIPTION: Keys this node stores, as owner or replica
+ */
+unsigned long MP2Node::keyCount()
+{
+	return ht->currentSize();
+}
+
+/**
+ * FUNCTION NAME: ownedShare
+ *
+ * DESCRIPTION: Part of the ring whose keys this node owns, as seen from its own ring
+ */
+double MP2Node::ownedShare()
+{
+	size_t t = tokens.size(), owned = 0;
+	for (size_t k = 0; k < t; k++)
+	{
+		if (replicaTable[k * par->REPLICAS].nodeAddress == memberNode->addr)
+		{
+			// Position k owns everything after the position before it, up to itself
+			owned += (tokens[k] + par->RING_POSITIONS - tokens[(k + t - 1) % t]) % par->RING_POSITIONS;
+		}
+	}
+	return (double)owned / par->RING_POSITIONS;
+}
+
 /**
  * FUNCTION NAME: findNodes
  *
  * DESCRIPTION: Find the replicas of the given keyfunction
  * 				This function is responsible for finding the replicas of a key
  */
-vector<Node> MP2Node::findNodes(string key)
+vector<Node> MP2Node::findNodes(const string &key)
 {
-	size_t pos = hashFunction(key);
-	vector<Node> addr_vec;
-	if (ring.size() >= 3)
+	ReplicaView replicas = replicasOf(hashFunction(key));
+	return vector<Node>(replicas.begin(), replicas.end());
+}
+
+/**
+ * FUNCTION NAME: coversKey
+ *
+ * DESCRIPTION: Whether the ring of this node is sure to hold the owner of position pos and the
+ * 				REPLICAS - 1 nodes after it. With a partial view only the RING_VIEW neighbours on
+ * 				each side are known to be complete. A view that never filled up holds every member
+ */
+bool MP2Node::coversKey(size_t pos)
+{
+	int n = ring.size();
+	if (par->MEMBERSHIP != PARTIAL_MEMBERSHIP || n - 1 < 2 * par->RING_VIEW)
+	{
+		return true;
+	}
+	int self = 0;
+	while (self < n && !(ring[self].nodeAddress == memberNode->addr))
+	{
+		self++;
+	}
+	if (self == n)
+	{
+		return false;
+	}
+	size_t from = ring[(self - par->RING_VIEW + n) % n].nodeHashCode;
+	size_t to = ring[(self + par->RING_VIEW - (par->REPLICAS - 1)) % n].nodeHashCode;
+	// In a large group the whole window can share one position, and then it covers nothing
+	if (from == to)
+	{
+		return false;
+	}
+	return from < to ? (pos > from && pos <= to) : (pos > from || pos <= to);
+}
+
+/**
+ * FUNCTION NAME: knowsReplicasOf
+ *
+ * DESCRIPTION: Whether findNodes gives the true replicas of key on this node
+ */
+bool MP2Node::knowsReplicasOf(const string &key)
+{
+	return coversKey(hashFunction(key));
+}
+
+/**
+ * FUNCTION NAME: nextHop
+ *
+ * DESCRIPTION: Index in the ring of the node closest before position pos, or -1 if that is this node
+ */
+int MP2Node::nextHop(size_t pos)
+{
+	int best = -1;
+	size_t bestDistance = 0;
+	for (uint i = 0; i < ring.size(); i++)
 	{
-		// if pos <= min || pos > max, the leader is the min
-		if (pos <= ring.at(0).getHashCode() || pos > ring.at(ring.size() - 1).getHashCode())
+		size_t distance = (pos + par->RING_POSITIONS - ring[i].nodeHashCode) % par->RING_POSITIONS;
+		if (best < 0 || distance < bestDistance)
 		{
-			addr_vec.emplace_back(ring.at(0));
-			addr_vec.emplace_back(ring.at(1));
-			addr_vec.emplace_back(ring.at(2));
+			best = i;
+			bestDistance = distance;
 		}
-		else
+	}
+	if (best >= 0 && ring[best].nodeAddress == memberNode->addr)
+	{
+		return -1;
+	}
+	return best;
+}
+
+/**
+ * FUNCTION NAME: sendToReplicas
+ *
+ * DESCRIPTION: Send a request to the replicas of its key, setting the replica type of each copy.
+ * 				A key this node cannot place goes to the closest node before it on the ring, in a
+ * 				FORWARD, until it reaches a node whose ring view covers it
+ */
+void MP2Node::sendToReplicas(Message &msg)
+{
+	size_t pos = hashFunction(msg.key);
+	if (!coversKey(pos))
+	{
+		int hop = nextHop(pos);
+		if (hop >= 0)
 		{
-			// go through the ring until pos <= node
-			for (uint i = 1; i < ring.size(); i++)
-			{
-				Node addr = ring.at(i);
-				if (pos <= addr.getHashCode())
-				{
-					addr_vec.emplace_back(addr);
-					addr_vec.emplace_back(ring.at((i + 1) % ring.size()));
-					addr_vec.emplace_back(ring.at((i + 2) % ring.size()));
-					break;
-				}
-			}
+			Message forward(msg.transID, memberNode->addr, FORWARD, msg.key, msg.toString());
+			emulNet->ENsend(&memberNode->addr, &ring[hop].nodeAddress, forward.toString());
+			return;
 		}
 	}
-	return addr_vec;
+
+	ReplicaView replicas = replicasOf(pos);
+	for (uint i = 0; i < replicas.size(); i++)
+	{
+		msg.replica = (ReplicaType)min(i, (uint)TERTIARY);
+		emulNet->ENsend(&memberNode->addr, &replicas[i].nodeAddress, msg.toString());
+	}
 }
 
 /**
@@ -571,39 +909,407 @@ bool MP2Node::recvLoop()
  * FUNCTION NAME: enqueueWrapper
  *
  * DESCRIPTION: Enqueue the message from Emulnet into the queue of MP2Node
+ * 				The buffer is owned by Emulnet and released after checkMessages
  */
 int MP2Node::enqueueWrapper(void *env, char *buff, int size)
 {
 	Queue q;
-	return q.enqueue((queue<q_elt> *)env, (void *)buff, size);
+	return q.enqueue((RingQueue<q_elt> *)env, (void *)buff, size);
 }
 /**
  * FUNCTION NAME: stabilizationProtocol
  *
  * DESCRIPTION: This runs the stabilization protocol in case of Node joins and leaves
- * 				It ensures that there always 3 copies of all keys in the DHT at all times
+ * 				It ensures that there always REPLICAS copies of all keys in the DHT at all times
  * 				The function does the following:
- *				1) Ensures that there are three "CORRECT" replicas of all the keys in spite of failures and joins
- *				Note:- "CORRECT" replicas implies that every key is replicated in its two neighboring nodes in the ring
+ *				1) Compares the replicas of every key this node holds before and after the ring change
+ *				2) Hands the key to the replicas it gained only, if this node is still a replica of it.
+ *				   Nodes detect failures at different times and may compare different rings, so every
+ *				   remaining replica sends, at most REPLICAS copies of what moved. When no replica
+ *				   is left from before, every holder sends
+ *				3) Drops the keys this node is no longer a replica of. Entries carry no versions,
+ *				   so a copy left behind would be stale by the time its range came back and would
+ *				   win the next repair
  */
 void MP2Node::stabilizationProtocol()
 {
-	/*
-	 * Implement this
-	 */
+	Node self(memberNode->addr);
+	vector<string> lost;
 	map<string, string>::iterator it;
 	for(it = ht->hashTable.begin(); it != ht->hashTable.end(); it++){
-		string key = it->first;
-		string value = it->second;
-		
-		vector<Node> replicas = findNodes(key);
-		g_transID++;
-		for (uint i = 0; i < replicas.size(); i++)
+		// Outside its ring view a node is no replica, the nodes that cover the key hand it over
+		size_t pos = hashFunction(it->first);
+		if (!coversKey(pos))
+		{
+			lost.push_back(it->first);
+			continue;
+		}
+		ReplicaView now = replicasOf(pos);
+		ReplicaView before = replicasIn(oldTokens, oldReplicaTable, pos);
+
+		// With no ring before, every holder sends to every replica, as nothing tells who else has the key
+		bool remains = false;
+		for (uint i = 0; !remains && i < now.size(); i++)
+		{
+			remains = holds(before, now[i]);
+		}
+		if (remains && !holds(now, self))
+		{
+			lost.push_back(it->first);
+			continue;
+		}
+
+		for (uint i = 0; i < now.size(); i++)
+		{
+			if (now[i].nodeAddress == self.nodeAddress || holds(before, now[i]))
+			{
+				continue;
+			}
+			Message message(STABILIZE_TRANSID, memberNode->addr, CREATE, it->first, it->second, (ReplicaType)min(i, (uint)TERTIARY));
+			pair<Address, vector<string> > &out = deferred[now[i].nodeAddress.getAddress()];
+			out.first = now[i].nodeAddress;
+			out.second.push_back(message.toString());
+		}
+		if (!holds(now, self))
+		{
+			lost.push_back(it->first);
+		}
+	}
+
+	// The queued CREATEs carry their own copy of the value
+	for (uint i = 0; i < lost.size(); i++)
+	{
+		string before = ht->read(lost[i]);
+		ht->deleteKey(lost[i]);
+		track(lost[i], before);
+	}
+}
+
+/**
+ * FUNCTION NAME: sendDeferred
+ *
+ * DESCRIPTION: Send the stabilization messages waiting for every replica whose queue is clear,
+ * 				packed into as few frames as possible, at most STABILIZE_RATE of them per call.
+ * 				Destinations are served in turn from where the previous call stopped, and the
+ * 				messages of frames the network refused wait for the next turn.
+ * 				Client requests are never held back
+ */
+void MP2Node::sendDeferred()
+{
+	size_t budget = par->STABILIZE_RATE > 0 ? par->STABILIZE_RATE : ~(size_t)0;
+	map<string, pair<Address, vector<string> > >::iterator it = deferred.lower_bound(deferredNext);
+	for (size_t visited = 0, total = deferred.size(); visited < total && budget > 0; visited++)
+	{
+		if (it == deferred.end())
+		{
+			it = deferred.begin();
+		}
+		vector<string> &msgs = it->second.second;
+		if (emulNet->ENpressure(&it->second.first) != EN_CLEAR)
+		{
+			it++;
+			continue;
+		}
+		vector<string> batch;
+		if (msgs.size() > budget)
+		{
+			batch.assign(msgs.begin(), msgs.begin() + budget);
+			msgs.erase(msgs.begin(), msgs.begin() + budget);
+		}
+		else
+		{
+			batch.swap(msgs);
+		}
+		budget -= batch.size();
+		emulNet->ENsendv(&memberNode->addr, &it->second.first, batch, &msgs);
+		if (msgs.empty())
+		{
+			deferred.erase(it++);
+		}
+		else
+		{
+			it++;
+		}
+	}
+	deferredNext = it == deferred.end() ? string() : it->first;
+}
+
+/**
+ * Records of MERKLE and SYNC messages are made of fields, each one its length, ':' and its bytes
+ */
+static void putField(string &out, const string &field)
+{
+	out += to_string(field.size()) + ":" + field;
+}
+
+/**
+ * false at the end of in, or if the bytes at there are not a field
+ */
+static bool getField(const string &in, size_t &at, string &field)
+{
+	size_t colon = in.find(':', at);
+	if (colon == string::npos || colon == at)
+	{
+		return false;
+	}
+	size_t len = strtoul(in.c_str() + at, NULL, 10);
+	if (len > in.size() - colon - 1)
+	{
+		return false;
+	}
+	field = in.substr(colon + 1, len);
+	at = colon + 1 + len;
+	return true;
+}
+
+/**
+ * FUNCTION NAME: antiEntropy
+ *
+ * DESCRIPTION: Every ANTI_ENTROPY_PERIOD time units, send the roots of the hash tree over every
+ * 				range this node owns to the other replicas of the range, in a MERKLE. Nodes are
+ * 				staggered by id so they do not all start in the same time unit
+ */
+void MP2Node::antiEntropy()
+{
+	int period = par->ANTI_ENTROPY_PERIOD;
+	if (period <= 0 || (par->getcurrtime() + *(int *)memberNode->addr.addr) % period != 0)
+	{
+		return;
+	}
+
+	map<string, long>::iterator tomb = tombstones.begin();
+	while (tomb != tombstones.end())
+	{
+		if (par->getcurrtime() - tomb->second > TOMBSTONE_PERIODS * period)
+		{
+			tombstones.erase(tomb++);
+		}
+		else
+		{
+			tomb++;
+		}
+	}
+
+	size_t t = tokens.size(), n = par->REPLICAS;
+	if (t == 0 || n < 2)
+	{
+		return;
+	}
+	map<string, pair<Address, vector<string> > > outgoing;
+	vector<int> roots;
+	for (size_t k = 0; k < t; k++)
+	{
+		size_t previous = tokens[(k + t - 1) % t];
+		if (!(replicaTable[k * n].nodeAddress == memberNode->addr) || previous == tokens[k])
+		{
+			continue;
+		}
+		// The range of position k is everything after the position before it, up to k
+		size_t from = (previous + 1) % par->RING_POSITIONS, to = tokens[k];
+		roots.clear();
+		if (from <= to)
+		{
+			merkle.cover(from, to, roots);
+		}
+		else
+		{
+			merkle.cover(from, par->RING_POSITIONS - 1, roots);
+			merkle.cover(0, to, roots);
+		}
+		for (size_t r = 1; r < n; r++)
+		{
+			Node &replica = replicaTable[k * n + r];
+			pair<Address, vector<string> > &out = outgoing[replica.nodeAddress.getAddress()];
+			out.first = replica.nodeAddress;
+			for (size_t i = 0; i < roots.size(); i++)
+			{
+				string record;
+				putField(record, to_string(roots[i]));
+				putField(record, to_string(merkle.hash(roots[i])));
+				out.second.push_back(record);
+			}
+		}
+	}
+
+	map<string, pair<Address, vector<string> > >::iterator dest;
+	for (dest = outgoing.begin(); dest != outgoing.end(); dest++)
+	{
+		sendPayloads(&dest->second.first, MERKLE, "", dest->second.second);
+	}
+}
+
+/**
+ * FUNCTION NAME: merkleHandler
+ *
+ * DESCRIPTION: Compare the hash tree nodes of a co-replica with ours. Of every node that differs
+ * 				the children go back in a MERKLE, so the two replicas walk down the differing
+ * 				branches only, and positions that differ are repaired with a SYNC
+ */
+void MP2Node::merkleHandler(Message &msg)
+{
+	vector<string> deeper;
+	vector<size_t> leaves;
+	string node, hash;
+	size_t at = 0;
+	while (getField(msg.value, at, node) && getField(msg.value, at, hash))
+	{
+		int i = atoi(node.c_str());
+		if (!merkle.valid(i) || merkle.hash(i) == strtoull(hash.c_str(), NULL, 10))
+		{
+			continue;
+		}
+		if (merkle.isLeaf(i))
+		{
+			leaves.push_back(merkle.positionOf(i));
+			continue;
+		}
+		for (int child = 2 * i; child <= 2 * i + 1; child++)
+		{
+			string record;
+			putField(record, to_string(child));
+			putField(record, to_string(merkle.hash(child)));
+			deeper.push_back(record);
+		}
+	}
+	if (!deeper.empty())
+	{
+		sendPayloads(&msg.fromAddr, MERKLE, "", deeper);
+	}
+	if (!leaves.empty())
+	{
+		sendRecords(&msg.fromAddr, leaves, true);
+	}
+}
+
+/**
+ * FUNCTION NAME: sendRecords
+ *
+ * DESCRIPTION: Send the entries and tombstones this node has at positions leaves in a SYNC,
+ * 				asking for those of the receiver in return if replyWanted
+ */
+void MP2Node::sendRecords(Address *toaddr, vector<size_t> &leaves, bool replyWanted)
+{
+	string header, positions;
+	vector<string> records;
+	for (size_t i = 0; i < leaves.size(); i++)
+	{
+		positions += (i ? "," : "") + to_string(leaves[i]);
+		unordered_map<size_t, vector<string> >::iterator held = positionKeys.find(leaves[i]);
+		if (held == positionKeys.end())
+		{
+			continue;
+		}
+		vector<string> &keys = held->second;
+		for (size_t j = 0; j < keys.size(); j++)
+		{
+			string record;
+			putField(record, "e");
+			putField(record, keys[j]);
+			putField(record, ht->read(keys[j]));
+			records.push_back(record);
+		}
+	}
+	map<string, long>::iterator tomb;
+	for (tomb = tombstones.begin(); tomb != tombstones.end(); tomb++)
+	{
+		if (find(leaves.begin(), leaves.end(), hashFunction(tomb->first)) != leaves.end())
+		{
+			string record;
+			putField(record, "t");
+			putField(record, tomb->first);
+			putField(record, "");
+			records.push_back(record);
+		}
+	}
+	putField(header, replyWanted ? "1" : "0");
+	putField(header, positions);
+	sendPayloads(toaddr, SYNC, header, records);
+}
+
+/**
+ * FUNCTION NAME: syncHandler
+ *
+ * DESCRIPTION: Take in the entries and tombstones of a co-replica. A missing key is created, and
+ * 				one known with another value takes the value of the owner of the key. Keys deleted
+ * 				lately on either side stay deleted
+ */
+void MP2Node::syncHandler(Message &msg)
+{
+	string replyWanted, positions, kind, key, value;
+	size_t at = 0;
+	if (!getField(msg.value, at, replyWanted) || !getField(msg.value, at, positions))
+	{
+		return;
+	}
+	while (getField(msg.value, at, kind) && getField(msg.value, at, key) && getField(msg.value, at, value))
+	{
+		if (kind == "t")
+		{
+			if (ht->count(key))
+			{
+				deletekey(key);
+			}
+			tombstones.insert(make_pair(key, (long)par->getcurrtime()));
+			continue;
+		}
+		if (tombstones.count(key))
+		{
+			continue;
+		}
+		string current = ht->read(key);
+		if (current.empty())
+		{
+			createKeyValue(key, value, PRIMARY);
+		}
+		else if (current != value)
+		{
+			ReplicaView replicas = replicasOf(hashFunction(key));
+			if (!replicas.empty() && replicas[0].nodeAddress == msg.fromAddr)
+			{
+				updateKeyValue(key, value, PRIMARY);
+			}
+		}
+	}
+
+	if (replyWanted == "1")
+	{
+		vector<size_t> leaves;
+		for (size_t start = 0; start < positions.size(); )
+		{
+			size_t comma = positions.find(',', start);
+			if (comma == string::npos)
+			{
+				comma = positions.size();
+			}
+			leaves.push_back(strtoul(positions.c_str() + start, NULL, 10) % par->RING_POSITIONS);
+			start = comma + 1;
+		}
+		sendRecords(&msg.fromAddr, leaves, false);
+	}
+}
+
+/**
+ * FUNCTION NAME: sendPayloads
+ *
+ * DESCRIPTION: Send records to toaddr in messages of type type, each one header followed by as
+ * 				many records as fit in half of MAX_MSG_SIZE, packed into as few frames as possible
+ */
+void MP2Node::sendPayloads(Address *toaddr, MessageType type, const string &header, vector<string> &records)
+{
+	vector<string> msgs;
+	string payload = header;
+	size_t limit = par->MAX_MSG_SIZE / 2;
+	for (size_t i = 0; i < records.size(); i++)
+	{
+		if (payload.size() > header.size() && payload.size() + records[i].size() > limit)
 		{
-			Message message(g_transID, memberNode->addr, CREATE, key, value, i == 0 ? PRIMARY : i == 1 ? SECONDARY : TERTIARY); //TODO: pass replica type
-			emulNet->ENsend(&memberNode->addr, &replicas[i].nodeAddress, message.toString());
+			msgs.push_back(Message(0, memberNode->addr, type, "", payload).toString());
+			payload = header;
 		}
+		payload += records[i];
 	}
+	msgs.push_back(Message(0, memberNode->addr, type, "", payload).toString());
+	emulNet->ENsendv(&memberNode->addr, toaddr, msgs);
 }
 
 /**
@@ -0,0 +1,174 @@
+/**********************************
+ * FILE NAME: MP2Node.h
+ *
+ * DESCRIPTION: MP2Node class header file
+ **********************************/
+
+#ifndef MP2NODE_H_
+#define MP2NODE_H_
+
+/**
+ * Header files
+ */
+#include "stdincludes.h"
+#include "EmulNet.h"
+#include "Node.h"
+#include "HashTable.h"
+#include "Log.h"
+#include "Params.h"
+#include "Message.h"
+#include "Queue.h"
+#include "MerkleTree.h"
+
+// Anti-entropy periods a deleted key is remembered, so that a replica that missed the delete
+// does not bring it back
+#define TOMBSTONE_PERIODS 4
+// transID of the CREATEs replicas hand each other. No coordinator waits for them, and they do
+// not bring back a key deleted since
+#define STABILIZE_TRANSID -1
+
+/**
+ * CLASS NAME: ReplicaView
+ *
+ * DESCRIPTION: The replicas of a key, owner first, read in place from the replica table of an
+ * 				MP2Node. Only valid until its ring next changes
+ */
+class ReplicaView {
+private:
+	Node *first;
+	size_t count;
+
+public:
+	ReplicaView(): first(NULL), count(0) {}
+	ReplicaView(Node *first, size_t count): first(first), count(count) {}
+	size_t size() const {
+		return count;
+	}
+	bool empty() const {
+		return 0 == count;
+	}
+	Node &operator[](size_t i) const {
+		return first[i];
+	}
+	Node *begin() const {
+		return first;
+	}
+	Node *end() const {
+		return first + count;
+	}
+};
+
+/**
+ * CLASS NAME: MP2Node
+ *
+ * DESCRIPTION: This class encapsulates all the key-value store functionality
+ * 				including:
+ * 				1) Ring
+ * 				2) Stabilization Protocol
+ * 				3) Server side CRUD APIs
+ * 				4) Client side CRUD APIs
+ */
+class MP2Node {
+private:
+	// Vector holding the next two neighbors in the ring who have my replicas
+	vector<Node> hasMyReplicas;
+	// Vector holding the previous two neighbors in the ring whose replicas I have
+	vector<Node> haveReplicasOf;
+	// Ring
+	vector<Node> ring;
+	// The VNODES positions of every node of the ring, sorted, for binary search
+	vector<size_t> tokens;
+	// Replicas of the keys each position owns, REPLICAS per position in the order of
+	// tokens. Rebuilt only when the ring changes
+	vector<Node> replicaTable;
+	// The tables before the last ring change, to tell which replicas a key gained
+	vector<size_t> oldTokens;
+	vector<Node> oldReplicaTable;
+	// Membership epoch the ring was last brought up to
+	long ringEpoch;
+	// Hash tree over the hash table, and the keys stored at each position of the ring that holds any
+	MerkleTree merkle;
+	unordered_map<size_t, vector<string> > positionKeys;
+	// Keys deleted lately, with the time of the delete
+	map<string, long> tombstones;
+	// Hash Table
+	HashTable * ht;
+	// Member representing this member
+	Member *memberNode;
+	// Params object
+	Params *par;
+	// Object of EmulNet
+	EmulNet * emulNet;
+	// Object of Log
+	Log * log;
+	// Stabilization messages not sent yet, by destination. Sent as the replica queues and
+	// STABILIZE_RATE allow
+	map<string, pair<Address, vector<string> > > deferred;
+	// Destination sendDeferred starts from next time, so every one gets its turn
+	string deferredNext;
+
+	void sendDeferred();
+	size_t tokenOf(Node &node, int vnode);
+	void buildReplicaTable();
+	ReplicaView replicasIn(vector<size_t> &tokens, vector<Node> &table, size_t pos);
+	bool inRing(Node &node);
+	static bool holds(ReplicaView &replicas, Node &node);
+	bool coversKey(size_t pos);
+	int nextHop(size_t pos);
+	void sendToReplicas(Message &msg);
+	void track(const string &key, const string &before);
+	void antiEntropy();
+	void merkleHandler(Message &msg);
+	void syncHandler(Message &msg);
+	void sendRecords(Address *toaddr, vector<size_t> &leaves, bool replyWanted);
+	void sendPayloads(Address *toaddr, MessageType type, const string &header, vector<string> &records);
+
+public:
+	MP2Node(Member *memberNode, Params *par, EmulNet *emulNet, Log *log, Address *addressOfMember);
+	Member * getMemberNode() {
+		return this->memberNode;
+	}
+
+	// ring functionalities
+	void updateRing();
+	bool applyChange(MembershipEvent &event);
+	vector<Node> getMembershipList();
+	size_t hashFunction(const string &key);
+
+	// client side CRUD APIs
+	void clientCreate(string key, string value);
+	void clientRead(string key);
+	void clientUpdate(string key, string value);
+	void clientDelete(string key);
+
+	// receive messages from Emulnet
+	bool recvLoop();
+	static int enqueueWrapper(void *env, char *buff, int size);
+
+	// handle messages from receiving queue
+	void checkMessages();
+
+	// find the addresses of nodes that are responsible for a key
+	ReplicaView replicasOf(size_t pos);
+	vector<Node> findNodes(const string &key);
+	bool knowsReplicasOf(const string &key);
+
+	// load distribution
+	unsigned long keyCount();
+	double ownedShare();
+
+	// server
+	bool createKeyValue(string key, string value, ReplicaType replica);
+	string readKey(string key);
+	bool updateKeyValue(string key, string value, ReplicaType replica);
+	bool deletekey(string key);
+
+	// stabilization protocol - handle multiple failures
+	void stabilizationProtocol();
+
+	void printAddress(Address *addr);
+
+	~MP2Node();
+};
+
+#endif /* MP2NODE_H_ */
@@ -8,6 +8,7 @@
 #define MEMBER_H_
 
 #include "stdincludes.h"
+#include "RingQueue.h"
 
 /**
  * CLASS NAME: q_elt
@@ -80,6 +81,31 @@ public:
 	void settimestamp(long timestamp);
 };
 
+/**
+ * Kinds of change to the membership table
+ */
+enum MembershipChange {
+	MEMBER_JOINED,
+	// Dropped from the table while alive, e.g. evicted from a partial view
+	MEMBER_LEFT,
+	MEMBER_FAILED
+};
+
+/**
+ * CLASS NAME: MembershipEvent
+ *
+ * DESCRIPTION: One change to the membership table, published by the membership protocol
+ */
+class MembershipEvent {
+public:
+	// Epoch of the table right after the change
+	long epoch;
+	MembershipChange change;
+	int id;
+	short port;
+	MembershipEvent(long epoch, MembershipChange change, int id, short port): epoch(epoch), change(change), id(id), port(port) {}
+};
+
 /**
  * CLASS NAME: Member
  *
@@ -108,14 +134,19 @@ public:
 	vector<MemberListEntry> memberList;
 	// My position in the membership table
 	vector<MemberListEntry>::iterator myPos;
+	// Bumped on every change to the membership table
+	long membershipEpoch;
+	// Changes not yet taken by the KV store, oldest first. The membership protocol may drop
+	// them all at any time, a reader that finds a gap rebuilds from memberList
+	vector<MembershipEvent> membershipEvents;
 	// Queue for failure detection messages
-	queue<q_elt> mp1q;
+	RingQueue<q_elt> mp1q;
 	// Queue for KVstore messages
-	queue<q_elt> mp2q;
+	RingQueue<q_elt> mp2q;
 	/**
 	 * Constructor
 	 */
-	Member(): inited(false), inGroup(false), bFailed(false), nnb(0), heartbeat(0), pingCounter(0), timeOutCounter(0) {}
+	Member(): inited(false), inGroup(false), bFailed(false), nnb(0), heartbeat(0), pingCounter(0), timeOutCounter(0), membershipEpoch(0) {}
 	// copy constructor
 	Member(const Member &anotherMember);
 	// Assignment operator overloading
@@ -0,0 +1,135 @@
+/**********************************
+ * FILE NAME: MemberIndex.h
+ *
+ * DESCRIPTION: Hash index over the membership table
+ **********************************/
+
+#ifndef MEMBERINDEX_H_
+#define MEMBERINDEX_H_
+
+#include "stdincludes.h"
+
+#define EMPTY_SLOT (~0ULL)
+
+/**
+ * CLASS NAME: MemberIndex
+ *
+ * DESCRIPTION: Maps (id, port) to the position of the entry in the membership table.
+ * 				Flat open addressing with linear probing, kept at most half full, and
+ * 				backward shift deletion so no tombstones build up
+ */
+class MemberIndex {
+private:
+	// Packed (id, port) of each slot, EMPTY_SLOT when free
+	vector<unsigned long long> keys;
+	vector<int> positions;
+	int count;
+
+	int slotOf(unsigned long long key) const {
+		// Fibonacci hashing spreads consecutive ids over the table
+		return (int)((key * 0x9E3779B97F4A7C15ULL) >> 40) & (keys.size() - 1);
+	}
+	void grow() {
+		vector<unsigned long long> oldKeys;
+		vector<int> oldPositions;
+		oldKeys.swap(keys);
+		oldPositions.swap(positions);
+		keys.assign(oldKeys.empty() ? 16 : 2 * oldKeys.size(), EMPTY_SLOT);
+		positions.assign(keys.size(), -1);
+		count = 0;
+		for ( unsigned int i = 0; i < oldKeys.size(); i++ ) {
+			if ( EMPTY_SLOT != oldKeys[i] ) {
+				put(oldKeys[i], oldPositions[i]);
+			}
+		}
+	}
+	void put(unsigned long long key, int pos) {
+		if ( 2 * (count + 1) > (int)keys.size() ) {
+			grow();
+		}
+		int mask = keys.size() - 1;
+		int s = slotOf(key);
+		while ( EMPTY_SLOT != keys[s] && key != keys[s] ) {
+			s = (s + 1) & mask;
+		}
+		if ( EMPTY_SLOT == keys[s] ) {
+			keys[s] = key;
+			count++;
+		}
+		positions[s] = pos;
+	}
+
+public:
+	MemberIndex(): count(0) {}
+
+	/**
+	 * (id, port) packed into one integer key
+	 */
+	static unsigned long long pack(int id, short port) {
+		return ((unsigned long long)(unsigned int)id << 16) | (unsigned short)port;
+	}
+
+	/**
+	 * Position of (id, port) in the table, -1 if it is not there
+	 */
+	int find(int id, short port) const {
+		if ( 0 == count ) {
+			return -1;
+		}
+		unsigned long long key = pack(id, port);
+		int mask = keys.size() - 1;
+		for ( int s = slotOf(key); EMPTY_SLOT != keys[s]; s = (s + 1) & mask ) {
+			if ( key == keys[s] ) {
+				return positions[s];
+			}
+		}
+		return -1;
+	}
+
+	/**
+	 * Insert (id, port) at pos, or move it there if it is already indexed
+	 */
+	void set(int id, short port, int pos) {
+		put(pack(id, port), pos);
+	}
+
+	void erase(int id, short port) {
+		if ( 0 == count ) {
+			return;
+		}
+		unsigned long long key = pack(id, port);
+		int mask = keys.size() - 1;
+		int s = slotOf(key);
+		while ( key != keys[s] ) {
+			if ( EMPTY_SLOT == keys[s] ) {
+				return;
+			}
+			s = (s + 1) & mask;
+		}
+		// Pull back every later entry of the run that may sit at or before the hole
+		int hole = s;
+		for ( s = (s + 1) & mask; EMPTY_SLOT != keys[s]; s = (s + 1) & mask ) {
+			int home = slotOf(keys[s]);
+			if ( ((s - home) & mask) >= ((s - hole) & mask) ) {
+				keys[hole] = keys[s];
+				positions[hole] = positions[s];
+				hole = s;
+			}
+		}
+		keys[hole] = EMPTY_SLOT;
+		positions[hole] = -1;
+		count--;
+	}
+
+	void clear() {
+		keys.clear();
+		positions.clear();
+		count = 0;
+	}
+
+	int size() const {
+		return count;
+	}
+};
+
+#endif /* MEMBERINDEX_H_ */
@@ -0,0 +1,93 @@
+/**********************************
+ * FILE NAME: MerkleTree.h
+ *
+ * DESCRIPTION: Hash tree over the positions of the ring
+ **********************************/
+
+#ifndef MERKLETREE_H_
+#define MERKLETREE_H_
+
+#include "stdincludes.h"
+
+/**
+ * CLASS NAME: MerkleTree
+ *
+ * DESCRIPTION: Hash of the keys and values stored at each of the size positions of the ring, a
+ * 				power of two, and of every aligned run of positions above them. Laid out as a
+ * 				heap: node 1 is the root, the children of node i are 2i and 2i + 1, and position
+ * 				pos is leaf size + pos. A leaf is the XOR of the hashes of its entries, so entries
+ * 				come and go in any order, and a change rehashes the log2(size) nodes above it.
+ * 				Two trees of the same size over the same entries are equal node by node
+ */
+class MerkleTree {
+private:
+	int size;
+	vector<unsigned long long> nodes;
+
+	static unsigned long long mix(unsigned long long left, unsigned long long right) {
+		// Not symmetric, so swapping two subtrees changes the parent
+		unsigned long long h = left * 0x9E3779B97F4A7C15ULL;
+		return h ^ (right + 0x632BE59BD9B4E019ULL + (h << 6) + (h >> 2));
+	}
+
+public:
+	MerkleTree(int size = RING_SIZE): size(size), nodes(2 * size, 0) {
+		for ( int i = size - 1; i >= 1; i-- ) {
+			nodes[i] = mix(nodes[2 * i], nodes[2 * i + 1]);
+		}
+	}
+
+	/**
+	 * Hash of one entry
+	 */
+	static unsigned long long entryHash(const string &key, const string &value) {
+		std::hash<string> hashFunc;
+		return hashFunc(key + '\0' + value);
+	}
+
+	/**
+	 * Add the entry (key, value) at position pos, or take it out if it is there
+	 */
+	void toggle(size_t pos, const string &key, const string &value) {
+		int i = size + pos;
+		nodes[i] ^= entryHash(key, value);
+		for ( i >>= 1; i >= 1; i >>= 1 ) {
+			nodes[i] = mix(nodes[2 * i], nodes[2 * i + 1]);
+		}
+	}
+
+	unsigned long long hash(int node) const {
+		return nodes[node];
+	}
+
+	bool valid(int node) const {
+		return node >= 1 && node < 2 * size;
+	}
+
+	bool isLeaf(int node) const {
+		return node >= size;
+	}
+
+	size_t positionOf(int leaf) const {
+		return leaf - size;
+	}
+
+	/**
+	 * Append the fewest nodes that together span exactly positions from to to, both included
+	 */
+	void cover(size_t from, size_t to, vector<int> &out) const {
+		int l = size + from, r = size + to + 1;
+		while ( l < r ) {
+			if ( l & 1 ) {
+				out.push_back(l++);
+			}
+			if ( r & 1 ) {
+				out.push_back(--r);
+			}
+			l >>= 1;
+			r >>= 1;
+		}
+	}
+};
+
+#endif /* MERKLETREE_H_ */
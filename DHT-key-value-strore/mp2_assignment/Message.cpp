@@ -14,6 +14,9 @@
 // transID::fromAddr::DELETE::key
 // transID::fromAddr::REPLY::sucess
 // transID::fromAddr::READREPLY::value
+// transID::fromAddr::FORWARD::message
+// transID::fromAddr::MERKLE::records
+// transID::fromAddr::SYNC::records
 Message::Message(string message){
 	this->delimiter = "::";
 	vector<string> tuple;
@@ -52,6 +55,12 @@ Message::Message(string message){
 		case READREPLY:
 			value = tuple.at(3);
 			break;
+		case FORWARD:
+		case MERKLE:
+		case SYNC:
+			// The forwarded message or the records are the rest, delimiters included
+			value = message.substr(tuple.at(0).size() + tuple.at(1).size() + tuple.at(2).size() + 3 * delimiter.size());
+			break;
 	}
 }
 
@@ -154,6 +163,9 @@ string Message::toString(){
 				message += "0";
 			break;
 		case READREPLY:
+		case FORWARD:
+		case MERKLE:
+		case SYNC:
 			message += value;
 			break;
 	}
@@ -6,6 +6,8 @@
 
 #include "Node.h"
 
+size_t Node::ringSize = RING_SIZE;
+
 /**
  * constructor
  */
@@ -30,7 +32,8 @@ Node::~Node() {}
  * DESCRIPTION: This function computes the hash code of the node address
  */
 void Node::computeHashCode() {
-	nodeHashCode = hashFunc(nodeAddress.addr)%RING_SIZE;
+	// Every byte counts, as a C string the address would stop at the first zero byte of the id
+	nodeHashCode = hashFunc(string(nodeAddress.addr, sizeof(nodeAddress.addr)))%ringSize;
 }
 
 /**
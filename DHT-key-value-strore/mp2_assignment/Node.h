@@ -15,6 +15,8 @@ public:
 	Address nodeAddress;
 	size_t nodeHashCode;
 	std::hash<string> hashFunc;
+	// Positions on the hash ring, Params::RING_POSITIONS once the run has started
+	static size_t ringSize;
 	Node();
 	Node(Address address);
 	Node(const Node& another);
@@ -19,6 +19,8 @@ Params::Params(): PORTNUM(8001) {}
 void Params::setparams(char *config_file) {
 	//trace.funcEntry("Params::setparams");
 	char CRUD[10];
+	char name[64];
+	char value[64];
 	FILE *fp = fopen(config_file,"r");
 
 	fscanf(fp,"MAX_NNB: %d", &MAX_NNB);
@@ -40,9 +42,200 @@ void Params::setparams(char *config_file) {
 		this->CRUDTEST = DELETE_TEST;
 	}
 
+	// Optional settings, one "NAME: value" per line after the test case parameters
+	TRANSPORT = EMUL_TRANSPORT;
+	LINK_DELAY = 0;
+	LINK_JITTER = 0;
+	LINK_BANDWIDTH = 0;
+	SLOW_NODES.clear();
+	SLOW_NODE_DELAY = 0;
+	QUORUM_TIMEOUT = 3;
+	REPLICAS = 3;
+	READ_QUORUM = 2;
+	WRITE_QUORUM = 2;
+	STABILIZE_RATE = 100;
+	ANTI_ENTROPY_PERIOD = 20;
+	QUEUE_LIMIT = 3000;
+	GOSSIP_FULL_SYNC = 10;
+	PHI_SUSPECT = 3;
+	PHI_REMOVE = 12;
+	MEMBERSHIP = GOSSIP_MEMBERSHIP;
+	SWIM_PERIOD = 8;
+	SWIM_PROXIES = 3;
+	SWIM_SUSPECT_TIMEOUT = 16;
+	SWIM_PIGGYBACK = 8;
+	RING_VIEW = 4;
+	VIEW_PASSIVE = 0;
+	SHUFFLE_PERIOD = 5;
+	SHUFFLE_LENGTH = 4;
+	SHIFT_TESTS = -1;
+	INTRODUCERS = 1;
+	VNODES = 1;
+	RING_POSITIONS = 0;
+	SHM_NAME = "/emulnet." + to_string(getpid());
+	SHM_RING_SIZE = 262144;
+	THREADS = 1;
+	SEED = time(NULL);
+	RECORD_FILE.clear();
+	REPLAY_FILE.clear();
+	while ( 2 == fscanf(fp, " %63[^:]: %63s", name, value) ) {
+		if ( 0 == strcmp(name, "TRANSPORT") ) {
+			if ( 0 == strcmp(value, "UDP") ) {
+				this->TRANSPORT = UDP_TRANSPORT;
+			}
+			else if ( 0 == strcmp(value, "SHM") ) {
+				this->TRANSPORT = SHM_TRANSPORT;
+			}
+			else {
+				this->TRANSPORT = EMUL_TRANSPORT;
+			}
+		}
+		else if ( 0 == strcmp(name, "LINK_DELAY") ) {
+			this->LINK_DELAY = atoi(value);
+		}
+		else if ( 0 == strcmp(name, "LINK_JITTER") ) {
+			this->LINK_JITTER = atoi(value);
+		}
+		else if ( 0 == strcmp(name, "LINK_BANDWIDTH") ) {
+			this->LINK_BANDWIDTH = atoi(value);
+		}
+		// May be given once per slow node
+		else if ( 0 == strcmp(name, "SLOW_NODE") ) {
+			this->SLOW_NODES.push_back(atoi(value));
+		}
+		else if ( 0 == strcmp(name, "SLOW_NODE_DELAY") ) {
+			this->SLOW_NODE_DELAY = atoi(value);
+		}
+		else if ( 0 == strcmp(name, "QUORUM_TIMEOUT") ) {
+			this->QUORUM_TIMEOUT = atoi(value);
+		}
+		else if ( 0 == strcmp(name, "REPLICAS") ) {
+			this->REPLICAS = max(1, atoi(value));
+		}
+		else if ( 0 == strcmp(name, "READ_QUORUM") ) {
+			this->READ_QUORUM = max(1, atoi(value));
+		}
+		else if ( 0 == strcmp(name, "WRITE_QUORUM") ) {
+			this->WRITE_QUORUM = max(1, atoi(value));
+		}
+		else if ( 0 == strcmp(name, "STABILIZE_RATE") ) {
+			this->STABILIZE_RATE = max(0, atoi(value));
+		}
+		else if ( 0 == strcmp(name, "ANTI_ENTROPY_PERIOD") ) {
+			this->ANTI_ENTROPY_PERIOD = max(0, atoi(value));
+		}
+		else if ( 0 == strcmp(name, "QUEUE_LIMIT") ) {
+			this->QUEUE_LIMIT = atoi(value);
+		}
+		else if ( 0 == strcmp(name, "GOSSIP_FULL_SYNC") ) {
+			this->GOSSIP_FULL_SYNC = max(1, atoi(value));
+		}
+		else if ( 0 == strcmp(name, "PHI_SUSPECT") ) {
+			this->PHI_SUSPECT = atof(value);
+		}
+		else if ( 0 == strcmp(name, "PHI_REMOVE") ) {
+			this->PHI_REMOVE = atof(value);
+		}
+		else if ( 0 == strcmp(name, "MEMBERSHIP") ) {
+			if ( 0 == strcmp(value, "SWIM") ) {
+				this->MEMBERSHIP = SWIM_MEMBERSHIP;
+			}
+			else if ( 0 == strcmp(value, "PARTIAL") ) {
+				this->MEMBERSHIP = PARTIAL_MEMBERSHIP;
+			}
+			else {
+				this->MEMBERSHIP = GOSSIP_MEMBERSHIP;
+			}
+		}
+		// A probe needs 6 time units to come back through a proxy
+		else if ( 0 == strcmp(name, "SWIM_PERIOD") ) {
+			this->SWIM_PERIOD = atoi(value);
+			if ( this->SWIM_PERIOD < 7 ) {
+				fprintf(stderr, "SWIM_PERIOD: %d is too short for a probe through a proxy to come back, 7 is used\n", this->SWIM_PERIOD);
+				this->SWIM_PERIOD = 7;
+			}
+		}
+		else if ( 0 == strcmp(name, "SWIM_PROXIES") ) {
+			this->SWIM_PROXIES = atoi(value);
+		}
+		else if ( 0 == strcmp(name, "SWIM_SUSPECT_TIMEOUT") ) {
+			this->SWIM_SUSPECT_TIMEOUT = atoi(value);
+		}
+		else if ( 0 == strcmp(name, "SWIM_PIGGYBACK") ) {
+			this->SWIM_PIGGYBACK = atoi(value);
+		}
+		// Replicas of a key are its owner and the two nodes after it, the ring view must hold them
+		else if ( 0 == strcmp(name, "RING_VIEW") ) {
+			this->RING_VIEW = atoi(value);
+		}
+		else if ( 0 == strcmp(name, "VIEW_PASSIVE") ) {
+			this->VIEW_PASSIVE = atoi(value);
+		}
+		else if ( 0 == strcmp(name, "SHUFFLE_PERIOD") ) {
+			this->SHUFFLE_PERIOD = max(1, atoi(value));
+		}
+		else if ( 0 == strcmp(name, "SHUFFLE_LENGTH") ) {
+			this->SHUFFLE_LENGTH = max(1, atoi(value));
+		}
+		else if ( 0 == strcmp(name, "INTRODUCERS") ) {
+			this->INTRODUCERS = max(1, atoi(value));
+		}
+		else if ( 0 == strcmp(name, "VNODES") ) {
+			this->VNODES = max(1, atoi(value));
+		}
+		else if ( 0 == strcmp(name, "SHIFT_TESTS") ) {
+			this->SHIFT_TESTS = atoi(value);
+		}
+		else if ( 0 == strcmp(name, "RING_POSITIONS") ) {
+			this->RING_POSITIONS = atoi(value);
+		}
+		else if ( 0 == strcmp(name, "SHM_NAME") ) {
+			this->SHM_NAME = value;
+		}
+		else if ( 0 == strcmp(name, "SHM_RING_SIZE") ) {
+			this->SHM_RING_SIZE = atoi(value);
+		}
+		else if ( 0 == strcmp(name, "THREADS") ) {
+			this->THREADS = atoi(value);
+		}
+		else if ( 0 == strcmp(name, "SEED") ) {
+			this->SEED = strtoul(value, NULL, 10);
+		}
+		// Two traces are written, <file>.mp1 and <file>.mp2, one per network
+		else if ( 0 == strcmp(name, "RECORD") ) {
+			this->RECORD_FILE = value;
+		}
+		else if ( 0 == strcmp(name, "REPLAY") ) {
+			this->REPLAY_FILE = value;
+		}
+	}
+	printf("Random seed: %u\n", SEED);
+
 	//printf("Parameters of the test case: %d %d %d %lf\n", MAX_NNB, SINGLE_FAILURE, DROP_MSG, MSG_DROP_PROB);
 
 	EN_GPSZ = MAX_NNB;
+	INTRODUCERS = min(INTRODUCERS, EN_GPSZ);
+	READ_QUORUM = min(READ_QUORUM, REPLICAS);
+	WRITE_QUORUM = min(WRITE_QUORUM, REPLICAS);
+	// The successors of a node in its view must hold every replica of the keys it owns
+	RING_VIEW = max(RING_VIEW, REPLICAS);
+	// A partial view only knows the ring right around a node, the positions of one node are all over it
+	if ( PARTIAL_MEMBERSHIP == MEMBERSHIP ) {
+		VNODES = 1;
+	}
+	// Only partial views are meant for groups too large to join before the inserts
+	if ( SHIFT_TESTS < 0 ) {
+		SHIFT_TESTS = PARTIAL_MEMBERSHIP == MEMBERSHIP;
+	}
+	if ( VIEW_PASSIVE <= 0 ) {
+		VIEW_PASSIVE = 4 * (int)ceil(log2(EN_GPSZ + 1));
+	}
+	// Enough positions that tokens seldom share one. A power of two for the hash tree, and at
+	// most 65536 so a position fits above the (id, port) of a member in a membership ring key
+	if ( RING_POSITIONS <= 0 ) {
+		RING_POSITIONS = max(RING_SIZE, 4 * EN_GPSZ * VNODES);
+	}
+	RING_POSITIONS = min(1 << (int)ceil(log2(max(RING_POSITIONS, 2))), 65536);
 	STEP_RATE=.25;
 	MAX_MSG_SIZE = 4000;
 	globaltime = 0;
@@ -12,6 +12,8 @@
 #include "Member.h"
 
 enum testTYPE { CREATE_TEST, READ_TEST, UPDATE_TEST, DELETE_TEST };
+enum transportTYPE { EMUL_TRANSPORT, UDP_TRANSPORT, SHM_TRANSPORT };
+enum membershipTYPE { GOSSIP_MEMBERSHIP, SWIM_MEMBERSHIP, PARTIAL_MEMBERSHIP };
 
 /**
  * CLASS NAME: Params
@@ -32,6 +34,41 @@ public:
 	int allNodesJoined;
 	short PORTNUM;
 	int CRUDTEST;
+	int TRANSPORT;              // network backend carrying the messages
+	int LINK_DELAY;             // time units every message spends on the wire
+	int LINK_JITTER;            // up to this many extra time units, drawn per message
+	int LINK_BANDWIDTH;         // bytes per time unit on each link, 0 for unlimited
+	vector<int> SLOW_NODES;     // ids whose links get SLOW_NODE_DELAY on top
+	int SLOW_NODE_DELAY;
+	int QUORUM_TIMEOUT;         // time units a coordinator waits for quorum replies
+	int REPLICAS;               // N: copies of every key
+	int READ_QUORUM;            // R: replies a read waits for
+	int WRITE_QUORUM;           // W: acks a create, update or delete waits for
+	int STABILIZE_RATE;         // keys a node hands over per time unit after ring changes, 0 for unlimited
+	int ANTI_ENTROPY_PERIOD;    // time units between two comparisons of a node with its co-replicas, 0 for never
+	int GOSSIP_FULL_SYNC;       // gossip rounds between two full membership lists, deltas in between
+	double PHI_SUSPECT;         // suspicion at which a member is no longer gossiped
+	double PHI_REMOVE;          // suspicion at which a member is removed
+	int MEMBERSHIP;             // failure detection protocol run by MP1Node
+	int SWIM_PERIOD;            // time units between two probes by the same node
+	int SWIM_PROXIES;           // members asked to probe indirectly when a direct probe is not acked
+	int SWIM_SUSPECT_TIMEOUT;   // time units a member stays suspected before it is removed
+	int SWIM_PIGGYBACK;         // membership updates carried by each SWIM message
+	int RING_VIEW;              // partial view: ring successors and predecessors monitored on each side
+	int VIEW_PASSIVE;           // partial view: members known but not monitored, 0 for 4 * log2 of the group size
+	int SHUFFLE_PERIOD;         // partial view: time units between two view exchanges by the same node
+	int SHUFFLE_LENGTH;         // partial view: members sent in a view exchange
+	int SHIFT_TESTS;            // push the test schedule back until the group has joined, -1 for PARTIAL only
+	int INTRODUCERS;            // nodes 1..INTRODUCERS answer JOINREQs, the others pick one by id
+	int VNODES;                 // positions of every node on the hash ring
+	int RING_POSITIONS;         // positions of the hash ring, a power of two, 0 to scale with the group
+	int QUEUE_LIMIT;            // frames that may be queued for one node before sends to it are refused
+	string SHM_NAME;            // prefix of the shared memory segments
+	int SHM_RING_SIZE;          // bytes of ring every node receives through in shared memory
+	int THREADS;                // worker threads driving the membership protocol, 1 for serial
+	unsigned int SEED;          // the only source of randomness of a run
+	string RECORD_FILE;         // write the network trace here, empty for none
+	string REPLAY_FILE;         // replay the network trace from here, empty for none
 	Params();
 	void setparams(char *);
 	int getcurrtime();
@@ -0,0 +1,82 @@
+/**********************************
+ * FILE NAME: PhiDetector.h
+ *
+ * DESCRIPTION: Phi accrual failure detection over heartbeat inter-arrival times
+ **********************************/
+
+#ifndef PHIDETECTOR_H_
+#define PHIDETECTOR_H_
+
+#include "stdincludes.h"
+
+// Inter-arrival times remembered per member
+#define PHI_WINDOW 16
+// Prior for a member not heard from yet: two intervals averaging this many time units, aged out like any other
+#define PHI_FIRST_INTERVAL 4
+// Floor of the deviation, in time units, so a member heard like clockwork is not removed after one late heartbeat
+#define PHI_MIN_STDDEV 2.0
+
+/**
+ * CLASS NAME: PhiDetector
+ *
+ * DESCRIPTION: Keeps the last PHI_WINDOW intervals between fresh heartbeats of one member in
+ * 				a ring. Suspicion is phi = -log10(P(no heartbeat for elapsed time units)) with
+ * 				normally distributed inter-arrival times of the mean and deviation of the ring,
+ * 				so members whose heartbeats come irregularly are given more time
+ */
+class PhiDetector {
+private:
+	int intervals[PHI_WINDOW];
+	int next;
+	int count;
+	long sum;
+	long squares;
+
+public:
+	PhiDetector(): next(0), count(0), sum(0), squares(0) {
+		arrival(PHI_FIRST_INTERVAL / 2);
+		arrival(PHI_FIRST_INTERVAL * 3 / 2);
+	}
+
+	/**
+	 * A fresh heartbeat came interval time units after the previous one
+	 */
+	void arrival(int interval) {
+		if ( interval <= 0 ) {
+			return;
+		}
+		if ( PHI_WINDOW == count ) {
+			sum -= intervals[next];
+			squares -= (long)intervals[next] * intervals[next];
+		}
+		else {
+			count++;
+		}
+		intervals[next] = interval;
+		sum += interval;
+		squares += (long)interval * interval;
+		next = (next + 1) % PHI_WINDOW;
+	}
+
+	double mean() const {
+		return (double)sum / count;
+	}
+
+	double stddev() const {
+		double m = mean();
+		double variance = (double)squares / count - m * m;
+		return max(PHI_MIN_STDDEV, sqrt(max(0.0, variance)));
+	}
+
+	double phi(long elapsed) const {
+		// Logistic approximation of the normal tail, as in the accrual detector of Akka
+		double y = (elapsed - mean()) / stddev();
+		double e = exp(-y * (1.5976 + 0.070566 * y * y));
+		if ( elapsed > mean() ) {
+			return -log10(e / (1.0 + e));
+		}
+		return -log10(1.0 - 1.0 / (1.0 + e));
+	}
+};
+
+#endif /* PHIDETECTOR_H_ */
@@ -19,7 +19,7 @@ class Queue {
 public:
 	Queue() {}
 	virtual ~Queue() {}
-	static bool enqueue(queue<q_elt> *queue, void *buffer, int size) {
+	static bool enqueue(RingQueue<q_elt> *queue, void *buffer, int size) {
 		q_elt element(buffer, size);
 		queue->emplace(element);
 		return true;
@@ -0,0 +1,67 @@
+/**********************************
+ * FILE NAME: RingQueue.h
+ *
+ * DESCRIPTION: FIFO queue over a growable ring buffer
+ **********************************/
+
+#ifndef RINGQUEUE_H_
+#define RINGQUEUE_H_
+
+#include "stdincludes.h"
+
+/**
+ * CLASS NAME: RingQueue
+ *
+ * DESCRIPTION: The part of std::queue the message queues use. Unlike the blocks of a deque,
+ * 				the ring is never handed back when the queue runs empty, so a queue drained
+ * 				every tick stops allocating once it has held the largest batch
+ */
+template <class T>
+class RingQueue {
+private:
+	vector<T> slots;
+	size_t head;
+	size_t count;
+
+public:
+	RingQueue(): head(0), count(0) {}
+
+	bool empty() const {
+		return 0 == count;
+	}
+
+	size_t size() const {
+		return count;
+	}
+
+	T &front() {
+		return slots[head];
+	}
+
+	void push(const T &element) {
+		if ( count == slots.size() ) {
+			// Full, copy out in order into a ring twice as large
+			vector<T> grown;
+			grown.reserve(max((size_t)16, 2 * count));
+			for ( size_t i = 0; i < count; i++ ) {
+				grown.push_back(slots[(head + i) % count]);
+			}
+			grown.resize(grown.capacity(), element);
+			slots.swap(grown);
+			head = 0;
+		}
+		slots[(head + count) % slots.size()] = element;
+		count++;
+	}
+
+	void emplace(const T &element) {
+		push(element);
+	}
+
+	void pop() {
+		head = (head + 1) % slots.size();
+		count--;
+	}
+};
+
+#endif /* RINGQUEUE_H_ */
@@ -0,0 +1,246 @@
+/**********************************
+ * FILE NAME: ShmNet.cpp
+ *
+ * DESCRIPTION: Shared memory network classes definition
+ **********************************/
+
+#include "ShmNet.h"
+
+/**
+ * Constructor
+ */
+ShmNet::ShmNet(Params *p, string name): EmulNet(p) {
+	this->name = name;
+	this->nnodes = p->EN_GPSZ + 1;
+	this->ringSize = (p->SHM_RING_SIZE + SHM_FRAMEALIGN - 1) & ~(SHM_FRAMEALIGN - 1);
+	this->segmentSize = sizeof(shm_ring) + ringSize;
+}
+
+/**
+ * Destructor
+ */
+ShmNet::~ShmNet() {}
+
+/**
+ * FUNCTION NAME: segmentOf
+ *
+ * DESCRIPTION: Map the segment of node id, creating it if no process has yet. A fresh
+ * 				segment is all zeroes, which is an empty ring
+ *
+ * RETURNS:
+ * The mapping, NULL if the segment cannot be mapped
+ */
+shm_segment *ShmNet::segmentOf(int id) {
+	unordered_map<int, shm_segment>::iterator it = segments.find(id);
+	if ( it != segments.end() ) {
+		return &it->second;
+	}
+	if ( id < 0 || id >= nnodes ) {
+		return NULL;
+	}
+
+	string path = name + "." + to_string(id);
+	struct stat st;
+	int fd = shm_open(path.c_str(), O_RDWR | O_CREAT | O_EXCL, 0600);
+	bool created = fd >= 0;
+	if ( created ) {
+		if ( ftruncate(fd, segmentSize) < 0 ) {
+			perror("ShmNet ftruncate");
+			exit(1);
+		}
+	}
+	else {
+		fd = shm_open(path.c_str(), O_RDWR, 0600);
+		if ( fd < 0 ) {
+			perror("ShmNet shm_open");
+			return NULL;
+		}
+		// Another process created it, wait until it has its full size. A creator that died
+		// before sizing it leaves it empty for good
+		long waited = 0;
+		for ( long pause = 100; ; pause = min(2 * pause, 100000L) ) {
+			if ( fstat(fd, &st) < 0 ) {
+				perror("ShmNet fstat");
+				exit(1);
+			}
+			if ( (size_t)st.st_size == segmentSize ) {
+				break;
+			}
+			if ( st.st_size > 0 ) {
+				fprintf(stderr, "ShmNet: %s has %ld bytes, %zu expected, SHM_RING_SIZE or MAX_NNB differ between processes\n",
+						path.c_str(), (long)st.st_size, segmentSize);
+				exit(1);
+			}
+			if ( waited >= SHM_OPEN_TIMEOUT * 1000L ) {
+				fprintf(stderr, "ShmNet: %s is still empty after %d ms, the process that created it is gone\n",
+						path.c_str(), SHM_OPEN_TIMEOUT);
+				exit(1);
+			}
+			usleep(pause);
+			waited += pause;
+		}
+	}
+
+	char *base = (char *) mmap(NULL, segmentSize, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+	close(fd);
+	if ( MAP_FAILED == base ) {
+		perror("ShmNet mmap");
+		return NULL;
+	}
+
+	shm_segment &seg = segments[id];
+	seg.ring = (shm_ring *) base;
+	seg.data = base + sizeof(shm_ring);
+	seg.created = created;
+	return &seg;
+}
+
+/**
+ * FUNCTION NAME: sendFrame
+ *
+ * DESCRIPTION: Reserve space for a frame in the ring of toaddr and write it there. A frame that
+ * 				would run past the end of the ring leaves a wrap marker and starts over at offset 0
+ *
+ * RETURNS:
+ * size
+ */
+int ShmNet::sendFrame(Address *myaddr, Address *toaddr, char *data, int size, int parts) {
+	int sendmsg = dropRoll(myaddr);
+	en_counters &stats = countersOf(myaddr);
+	int src = *(int *)(myaddr->addr);
+	int frameSize = (sizeof(shm_frame) + sizeof(en_msg) + size + SHM_FRAMEALIGN - 1) & ~(SHM_FRAMEALIGN - 1);
+
+	if ( size + (int)sizeof(en_msg) >= par->MAX_MSG_SIZE || frameSize > ringSize ) {
+		stats.oversized++;
+		return 0;
+	}
+	if ( par->dropmsg && sendmsg < (int) (par->MSG_DROP_PROB * 100) ) {
+		stats.dropped++;
+		return 0;
+	}
+
+	shm_segment *seg = segmentOf(*(int *)(toaddr->addr));
+	if ( NULL == seg ) {
+		stats.dropped++;
+		return 0;
+	}
+
+	// Other senders may move tail at the same time, the one whose swap succeeds owns the space.
+	// head is read first, so it is never past the tail read after it
+	shm_ring *ring = seg->ring;
+	unsigned long long head, tail;
+	int offset, skip;
+	do {
+		head = ring->head.load(memory_order_acquire);
+		tail = ring->tail.load(memory_order_relaxed);
+		offset = tail % ringSize;
+		skip = ( offset + frameSize > ringSize ) ? ringSize - offset : 0;
+		if ( tail + skip + frameSize - head > (unsigned long long)ringSize ) {
+			stats.overflowed++;
+			return 0;
+		}
+	} while ( !ring->tail.compare_exchange_weak(tail, tail + skip + frameSize, memory_order_relaxed) );
+
+	if ( skip ) {
+		shm_frame *wrap = (shm_frame *)(seg->data + offset);
+		wrap->length = -1;
+		wrap->seq.store(tail + 1, memory_order_release);
+		tail += skip;
+		offset = 0;
+	}
+	shm_frame *frame = (shm_frame *)(seg->data + offset);
+	en_msg *em = (en_msg *)(frame + 1);
+	em->size = size;
+	em->parts = parts;
+	memcpy(&(em->from.addr), &(myaddr->addr), sizeof(em->from.addr));
+	memcpy(&(em->to.addr), &(toaddr->addr), sizeof(em->to.addr));
+	memcpy(em + 1, data, size);
+	frame->length = size;
+	frame->seq.store(tail + 1, memory_order_release);
+
+	stats.sent++;
+	stats.bytes += size;
+	sent_msgs.inc(src, par->getcurrtime());
+
+	return size;
+}
+
+/**
+ * FUNCTION NAME: ENrecv
+ *
+ * DESCRIPTION: Deliver the frames written to the segment of myaddr, in the order their space was
+ * 				reserved, up to the first one still being written. Frames stay in the ring, and the
+ * 				space is only handed back to the senders by ENrelease
+ *
+ * RETURN:
+ * 0
+ */
+int ShmNet::ENrecv(Address *myaddr, int (* enq)(void *, char *, int), struct timeval *t, int times, void *queue) {
+	int dst = *(int *)(myaddr->addr);
+	int time = par->getcurrtime();
+	shm_segment *seg = segmentOf(dst);
+
+	if ( NULL == seg ) {
+		return 0;
+	}
+
+	shm_ring *ring = seg->ring;
+	while ( true ) {
+		int offset = ring->read % ringSize;
+		shm_frame *frame = (shm_frame *)(seg->data + offset);
+		if ( frame->seq.load(memory_order_acquire) != ring->read + 1 ) {
+			break;
+		}
+		if ( frame->length < 0 ) {
+			ring->read += ringSize - offset;
+			continue;
+		}
+		deliverFrame((en_msg *)(frame + 1), enq, queue);
+		recv_msgs.inc(dst, time);
+		ring->read += (sizeof(shm_frame) + sizeof(en_msg) + frame->length + SHM_FRAMEALIGN - 1) & ~(SHM_FRAMEALIGN - 1);
+	}
+
+	return 0;
+}
+
+/**
+ * FUNCTION NAME: ENrelease
+ *
+ * DESCRIPTION: Hand the ring space of every frame delivered to myaddr back to the senders. The
+ * 				space is cleared first, so what is left of old frames never passes for a new one
+ */
+void ShmNet::ENrelease(Address *myaddr) {
+	unordered_map<int, shm_segment>::iterator it = segments.find(*(int *)(myaddr->addr));
+	if ( it == segments.end() ) {
+		return;
+	}
+	shm_ring *ring = it->second.ring;
+	unsigned long long head = ring->head.load(memory_order_relaxed);
+	while ( head < ring->read ) {
+		int offset = head % ringSize;
+		int n = (int)min((unsigned long long)(ringSize - offset), ring->read - head);
+		memset(it->second.data + offset, 0, n);
+		head += n;
+	}
+	ring->head.store(ring->read, memory_order_release);
+}
+
+/**
+ * FUNCTION NAME: ENcleanup
+ *
+ * DESCRIPTION: Unmap every segment this process used, remove the ones it created and write the
+ * 				message counts. Segments other processes created stay theirs to remove.
+ * 				Called exactly once at the end of the program.
+ */
+int ShmNet::ENcleanup() {
+	unordered_map<int, shm_segment>::iterator it;
+	for ( it = segments.begin(); it != segments.end(); it++ ) {
+		munmap(it->second.ring, segmentSize);
+		if ( it->second.created ) {
+			shm_unlink((name + "." + to_string(it->first)).c_str());
+		}
+	}
+	segments.clear();
+
+	return EmulNet::ENcleanup();
+}
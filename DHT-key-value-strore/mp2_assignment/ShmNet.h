@@ -0,0 +1,95 @@
+/**********************************
+ * FILE NAME: ShmNet.h
+ *
+ * DESCRIPTION: Shared memory network classes header file
+ **********************************/
+
+#ifndef _SHMNET_H_
+#define _SHMNET_H_
+
+// Frames start on 16 bytes, so the space a wrap leaves always fits a frame header
+#define SHM_FRAMEALIGN 16
+// Milliseconds to wait for another process to size a segment it created
+#define SHM_OPEN_TIMEOUT 5000
+
+#include "stdincludes.h"
+#include "EmulNet.h"
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+
+/**
+ * Struct Name: shm_ring
+ *
+ * DESCRIPTION: Control block of the multi-producer single-consumer ring at the start of a segment.
+ * 				Positions only ever grow, the offset in the ring is position % ringSize. Senders
+ * 				reserve space by moving tail with a compare and swap. head and tail sit on their
+ * 				own cache lines since different processes write them
+ */
+typedef struct shm_ring {
+	// Consumed and released by the receiver
+	atomic<unsigned long long> head;
+	char pad1[64 - sizeof(atomic<unsigned long long>)];
+	// Reserved by the senders, frames below it may still be being written
+	atomic<unsigned long long> tail;
+	char pad2[64 - sizeof(atomic<unsigned long long>)];
+	// Read by the receiver but not released yet, only the receiver touches it
+	unsigned long long read;
+	char pad3[64 - sizeof(unsigned long long)];
+}shm_ring;
+
+/**
+ * Struct Name: shm_frame
+ *
+ * DESCRIPTION: Header of a frame in the ring, followed by an en_msg and its payload. The sender
+ * 				stores seq last, as the position of the frame plus one, so a frame is complete once
+ * 				seq matches where the receiver reads. length < 0 marks the end of the ring
+ */
+typedef struct shm_frame {
+	atomic<unsigned long long> seq;
+	int length;
+	int pad;
+}shm_frame;
+
+/**
+ * Struct Name: shm_segment
+ *
+ * DESCRIPTION: Mapping of the segment of one receiving node: the control block, then the ring data
+ */
+typedef struct shm_segment {
+	shm_ring *ring;
+	char *data;
+	// Whether this process created the segment, and so removes it at cleanup
+	bool created;
+}shm_segment;
+
+/**
+ * CLASS NAME: ShmNet
+ *
+ * DESCRIPTION: Same contract as EmulNet, but every node receives through a segment in /dev/shm
+ * 				holding one ring all senders write to, so memory grows with the number of nodes
+ * 				and a receive only touches the frames that arrived. Segments are named by node id.
+ * 				All nodes are driven by the one process running the Application. Frames are
+ * 				delivered in place and the ring space is handed back on ENrelease
+ */
+class ShmNet : public EmulNet
+{
+private:
+	// Segment names are <name>.<id>
+	string name;
+	int nnodes;
+	int ringSize;
+	size_t segmentSize;
+	unordered_map<int, shm_segment> segments;
+	shm_segment *segmentOf(int id);
+protected:
+	int sendFrame(Address *myaddr, Address *toaddr, char *data, int size, int parts);
+public:
+	ShmNet(Params *p, string name);
+	virtual ~ShmNet();
+	int ENrecv(Address *myaddr, int (* enq)(void *, char *, int), struct timeval *t, int times, void *queue);
+	void ENrelease(Address *myaddr);
+	int ENcleanup();
+};
+
+#endif /* _SHMNET_H_ */
@@ -0,0 +1,310 @@
+/**********************************
+ * FILE NAME: UdpNet.cpp
+ *
+ * DESCRIPTION: UDP loopback network classes definition
+ **********************************/
+
+#include "UdpNet.h"
+
+/**
+ * Constructor
+ */
+UdpNet::UdpNet(Params *p, int basePort): EmulNet(p) {
+	this->basePort = basePort;
+	this->frameSize = p->MAX_MSG_SIZE;
+	this->pendingSends = 0;
+}
+
+/**
+ * Destructor
+ */
+UdpNet::~UdpNet() {}
+
+/**
+ * FUNCTION NAME: portOf
+ *
+ * DESCRIPTION: UDP port owned by the node with this address
+ */
+unsigned short UdpNet::portOf(Address *addr) {
+	int id;
+	memcpy(&id, &addr->addr[0], sizeof(int));
+	return (unsigned short)(basePort + id);
+}
+
+/**
+ * FUNCTION NAME: sockFor
+ *
+ * DESCRIPTION: Socket of a local node, bound on first use. A node whose port would be past
+ * 				65535 stops the run rather than wrap onto the port of another node
+ */
+udp_sock &UdpNet::sockFor(Address *addr) {
+	unordered_map<unsigned long long, udp_sock>::iterator it = socks.find(EM::key(addr));
+	if ( it != socks.end() ) {
+		return it->second;
+	}
+
+	int id;
+	memcpy(&id, &addr->addr[0], sizeof(int));
+	if ( id < 0 || basePort + id > 65535 ) {
+		fprintf(stderr, "UdpNet: node %d needs port %d, only 0 to 65535 exist. Lower MAX_NNB\n",
+				id, basePort + id);
+		exit(1);
+	}
+
+	udp_sock &s = socks[EM::key(addr)];
+	struct sockaddr_in sa;
+	int rcvbuf = UDP_RCVBUF;
+
+	s.fd = socket(AF_INET, SOCK_DGRAM, 0);
+	if ( s.fd < 0 ) {
+		perror("UdpNet socket");
+		exit(1);
+	}
+	setsockopt(s.fd, SOL_SOCKET, SO_RCVBUF, &rcvbuf, sizeof(rcvbuf));
+
+	memset(&sa, 0, sizeof(sa));
+	sa.sin_family = AF_INET;
+	sa.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+	sa.sin_port = htons(portOf(addr));
+	if ( bind(s.fd, (struct sockaddr *)&sa, sizeof(sa)) < 0 ) {
+		perror("UdpNet bind");
+		exit(1);
+	}
+
+	s.owner = *addr;
+	s.outBuf = (char *) malloc(UDP_BATCH * frameSize);
+	s.outCount = 0;
+	return s;
+}
+
+/**
+ * FUNCTION NAME: ENinit
+ *
+ * DESCRIPTION: Init the emulnet for this node and bind its socket
+ */
+void *UdpNet::ENinit(Address *myaddr, short port) {
+	EmulNet::ENinit(myaddr, port);
+	sockFor(myaddr);
+	return myaddr;
+}
+
+/**
+ * FUNCTION NAME: flush
+ *
+ * DESCRIPTION: Push the queued frames of one node onto the wire
+ */
+void UdpNet::flush(udp_sock &s) {
+	struct mmsghdr hdrs[UDP_BATCH];
+	struct iovec iovs[UDP_BATCH];
+	struct sockaddr_in dests[UDP_BATCH];
+	int i, sent, retries = 0;
+
+	if ( 0 == s.outCount ) {
+		return;
+	}
+
+	memset(hdrs, 0, sizeof(hdrs));
+	for ( i = 0; i < s.outCount; i++ ) {
+		iovs[i].iov_base = s.outBuf + i * frameSize;
+		iovs[i].iov_len = s.outSizes[i];
+		memset(&dests[i], 0, sizeof(dests[i]));
+		dests[i].sin_family = AF_INET;
+		dests[i].sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+		dests[i].sin_port = htons(s.outPorts[i]);
+		hdrs[i].msg_hdr.msg_name = &dests[i];
+		hdrs[i].msg_hdr.msg_namelen = sizeof(dests[i]);
+		hdrs[i].msg_hdr.msg_iov = &iovs[i];
+		hdrs[i].msg_hdr.msg_iovlen = 1;
+	}
+
+	// A full socket buffer is retried a few times. A datagram the kernel still refuses is lost
+	// and taken back out of the sent counts, like a refused frame on the emulated network
+	for ( i = 0; i < s.outCount; i += sent ) {
+		sent = sendmmsg(s.fd, hdrs + i, s.outCount - i, 0);
+		if ( sent > 0 ) {
+			retries = 0;
+			continue;
+		}
+		sent = 0;
+		if ( EINTR == errno ) {
+			continue;
+		}
+		bool full = EAGAIN == errno || EWOULDBLOCK == errno || ENOBUFS == errno;
+		if ( full && retries++ < UDP_SEND_RETRIES ) {
+			sched_yield();
+			continue;
+		}
+		en_counters &stats = countersOf(&s.owner);
+		if ( full ) {
+			stats.overflowed++;
+		}
+		else {
+			stats.dropped++;
+		}
+		stats.sent--;
+		stats.bytes -= s.outSizes[i] - (int)sizeof(en_msg);
+		retries = 0;
+		sent = 1;
+	}
+
+	pendingSends -= s.outCount;
+	s.outCount = 0;
+}
+
+/**
+ * FUNCTION NAME: flushAll
+ *
+ * DESCRIPTION: Push the queued frames of every local node onto the wire
+ */
+void UdpNet::flushAll() {
+	unordered_map<unsigned long long, udp_sock>::iterator it;
+	for ( it = socks.begin(); it != socks.end() && pendingSends > 0; it++ ) {
+		flush(it->second);
+	}
+}
+
+/**
+ * FUNCTION NAME: sendFrame
+ *
+ * DESCRIPTION: Queue a frame on the socket of myaddr. It goes out with the next sendmmsg batch
+ *
+ * RETURNS:
+ * size
+ */
+int UdpNet::sendFrame(Address *myaddr, Address *toaddr, char *data, int size, int parts) {
+	int sendmsg = dropRoll(myaddr);
+	en_counters &stats = countersOf(myaddr);
+
+	if ( size + (int)sizeof(en_msg) >= par->MAX_MSG_SIZE ) {
+		stats.oversized++;
+		return 0;
+	}
+	if ( par->dropmsg && sendmsg < (int) (par->MSG_DROP_PROB * 100) ) {
+		stats.dropped++;
+		return 0;
+	}
+
+	udp_sock &s = sockFor(myaddr);
+	if ( UDP_BATCH == s.outCount ) {
+		flush(s);
+	}
+
+	en_msg *em = (en_msg *)(s.outBuf + s.outCount * frameSize);
+	em->size = size;
+	em->parts = parts;
+	memcpy(&(em->from.addr), &(myaddr->addr), sizeof(em->from.addr));
+	memcpy(&(em->to.addr), &(toaddr->addr), sizeof(em->to.addr));
+	memcpy(em + 1, data, size);
+
+	s.outSizes[s.outCount] = sizeof(en_msg) + size;
+	s.outPorts[s.outCount] = portOf(toaddr);
+	s.outCount++;
+	pendingSends++;
+
+	stats.sent++;
+	stats.bytes += size;
+	sent_msgs.inc(*(int *)(myaddr->addr), par->getcurrtime());
+
+	return size;
+}
+
+/**
+ * FUNCTION NAME: ENrecv
+ *
+ * DESCRIPTION: Drain the socket of myaddr with recvmmsg. As with EmulNet the buffers handed
+ * 				to enq stay valid until the receiver calls ENrelease
+ *
+ * RETURN:
+ * 0
+ */
+int UdpNet::ENrecv(Address *myaddr, int (* enq)(void *, char *, int), struct timeval *t, int times, void *queue) {
+	struct mmsghdr hdrs[UDP_BATCH];
+	struct iovec iovs[UDP_BATCH];
+	char *block;
+	en_msg *emsg;
+	int i, n;
+
+	// Everything sent so far must be visible to this receive
+	flushAll();
+
+	udp_sock &s = sockFor(myaddr);
+	int dst = *(int *)(myaddr->addr);
+	int time = par->getcurrtime();
+
+	do {
+		if ( freeBlocks.empty() ) {
+			block = (char *) malloc(UDP_BATCH * frameSize);
+		}
+		else {
+			block = freeBlocks.back();
+			freeBlocks.pop_back();
+		}
+
+		memset(hdrs, 0, sizeof(hdrs));
+		for ( i = 0; i < UDP_BATCH; i++ ) {
+			iovs[i].iov_base = block + i * frameSize;
+			iovs[i].iov_len = frameSize;
+			hdrs[i].msg_hdr.msg_iov = &iovs[i];
+			hdrs[i].msg_hdr.msg_iovlen = 1;
+		}
+
+		n = recvmmsg(s.fd, hdrs, UDP_BATCH, MSG_DONTWAIT, NULL);
+		if ( n <= 0 ) {
+			freeBlocks.push_back(block);
+			break;
+		}
+
+		for ( i = 0; i < n; i++ ) {
+			emsg = (en_msg *)(block + i * frameSize);
+			if ( hdrs[i].msg_len < sizeof(en_msg) || (int)(hdrs[i].msg_len - sizeof(en_msg)) != emsg->size ) {
+				continue;
+			}
+			deliverFrame(emsg, enq, queue);
+			recv_msgs.inc(dst, time);
+		}
+		s.deliveredBlocks.push_back(block);
+	} while ( UDP_BATCH == n );
+
+	return 0;
+}
+
+/**
+ * FUNCTION NAME: ENrelease
+ *
+ * DESCRIPTION: Recycle the receive blocks of every frame delivered to myaddr
+ */
+void UdpNet::ENrelease(Address *myaddr) {
+	unordered_map<unsigned long long, udp_sock>::iterator it = socks.find(EM::key(myaddr));
+	if ( it == socks.end() ) {
+		return;
+	}
+	vector<char *> &blocks = it->second.deliveredBlocks;
+	freeBlocks.insert(freeBlocks.end(), blocks.begin(), blocks.end());
+	blocks.clear();
+}
+
+/**
+ * FUNCTION NAME: ENcleanup
+ *
+ * DESCRIPTION: Close every socket, free the buffers and write the message counts.
+ * 				Called exactly once at the end of the program.
+ */
+int UdpNet::ENcleanup() {
+	unordered_map<unsigned long long, udp_sock>::iterator it;
+	for ( it = socks.begin(); it != socks.end(); it++ ) {
+		close(it->second.fd);
+		free(it->second.outBuf);
+		for ( unsigned int k = 0; k < it->second.deliveredBlocks.size(); k++ ) {
+			free(it->second.deliveredBlocks[k]);
+		}
+	}
+	socks.clear();
+	pendingSends = 0;
+
+	while ( !freeBlocks.empty() ) {
+		free(freeBlocks.back());
+		freeBlocks.pop_back();
+	}
+
+	return EmulNet::ENcleanup();
+}
@@ -0,0 +1,75 @@
+/**********************************
+ * FILE NAME: UdpNet.h
+ *
+ * DESCRIPTION: UDP loopback network classes header file
+ **********************************/
+
+#ifndef _UDPNET_H_
+#define _UDPNET_H_
+
+#define UDP_BATCH 32
+#define UDP_RCVBUF (4 * 1024 * 1024)
+// Times a batch the kernel has no room for is retried before its frames count as overflowed
+#define UDP_SEND_RETRIES 8
+
+#include "stdincludes.h"
+#include "EmulNet.h"
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <errno.h>
+#include <sched.h>
+
+/**
+ * Struct Name: udp_sock
+ *
+ * DESCRIPTION: Socket of one local node along with the datagrams it has queued for sending
+ */
+typedef struct udp_sock {
+	int fd;
+	// Node the socket belongs to, whose counters its lost frames go to
+	Address owner;
+	// UDP_BATCH outgoing frames of frameSize bytes each, flushed with one sendmmsg
+	char *outBuf;
+	int outCount;
+	int outSizes[UDP_BATCH];
+	unsigned short outPorts[UDP_BATCH];
+	// Receive blocks whose frames were handed to the node, recycled by ENrelease
+	vector<char *> deliveredBlocks;
+}udp_sock;
+
+/**
+ * CLASS NAME: UdpNet
+ *
+ * DESCRIPTION: Same contract as EmulNet, but frames travel as real UDP datagrams over
+ * 				127.0.0.1. The node with id i owns port basePort + i. Sends are batched per node
+ * 				and go out with sendmmsg before the next receive, receives drain the socket
+ * 				with recvmmsg
+ */
+class UdpNet : public EmulNet
+{
+private:
+	// Port of node 0, node i owns basePort + i
+	int basePort;
+	// Largest frame on the wire
+	int frameSize;
+	int pendingSends;
+	unordered_map<unsigned long long, udp_sock> socks;
+	// Receive blocks of UDP_BATCH * frameSize bytes
+	vector<char *> freeBlocks;
+	udp_sock &sockFor(Address *addr);
+	unsigned short portOf(Address *addr);
+	void flush(udp_sock &s);
+	void flushAll();
+protected:
+	int sendFrame(Address *myaddr, Address *toaddr, char *data, int size, int parts);
+public:
+	UdpNet(Params *p, int basePort);
+	virtual ~UdpNet();
+	void *ENinit(Address *myaddr, short port);
+	int ENrecv(Address *myaddr, int (* enq)(void *, char *, int), struct timeval *t, int times, void *queue);
+	void ENrelease(Address *myaddr);
+	int ENcleanup();
+};
+
+#endif /* _UDPNET_H_ */
@@ -0,0 +1,76 @@
+/**********************************
+ * FILE NAME: WorkerPool.cpp
+ *
+ * DESCRIPTION: Definition of the worker pool driving nodes in parallel
+ **********************************/
+
+#include "WorkerPool.h"
+
+/**
+ * Constructor
+ */
+WorkerPool::WorkerPool(int threads): jobSize(0), nextIndex(0), busy(0), generation(0), stopping(false) {
+	for ( int i = 0; i < threads; i++ ) {
+		workers.push_back(thread(&WorkerPool::work, this));
+	}
+}
+
+/**
+ * Destructor
+ */
+WorkerPool::~WorkerPool() {
+	{
+		unique_lock<mutex> guard(lock);
+		stopping = true;
+	}
+	wake.notify_all();
+	for ( unsigned int i = 0; i < workers.size(); i++ ) {
+		workers[i].join();
+	}
+}
+
+/**
+ * FUNCTION NAME: parallelFor
+ *
+ * DESCRIPTION: Run f(0) ... f(n-1) on the workers, in no particular order, and wait for all of them
+ */
+void WorkerPool::parallelFor(int n, function<void(int)> f) {
+	unique_lock<mutex> guard(lock);
+	job = f;
+	jobSize = n;
+	nextIndex = 0;
+	busy = workers.size();
+	generation++;
+	wake.notify_all();
+	finished.wait(guard, [this] { return 0 == busy; });
+}
+
+/**
+ * FUNCTION NAME: work
+ *
+ * DESCRIPTION: Worker thread body: wait for a job, take indices until none are left
+ */
+void WorkerPool::work() {
+	unsigned long seen = 0;
+	int i;
+
+	while ( true ) {
+		{
+			unique_lock<mutex> guard(lock);
+			wake.wait(guard, [this, seen] { return stopping || generation != seen; });
+			if ( stopping ) {
+				return;
+			}
+			seen = generation;
+		}
+
+		while ( (i = nextIndex.fetch_add(1)) < jobSize ) {
+			job(i);
+		}
+
+		unique_lock<mutex> guard(lock);
+		if ( 0 == --busy ) {
+			finished.notify_one();
+		}
+	}
+}
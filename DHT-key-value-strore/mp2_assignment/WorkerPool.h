@@ -0,0 +1,43 @@
+/**********************************
+ * FILE NAME: WorkerPool.h
+ *
+ * DESCRIPTION: Header file of the worker pool driving nodes in parallel
+ **********************************/
+
+#ifndef _WORKERPOOL_H_
+#define _WORKERPOOL_H_
+
+#include "stdincludes.h"
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+#include <atomic>
+
+/**
+ * CLASS NAME: WorkerPool
+ *
+ * DESCRIPTION: Fixed set of threads. parallelFor hands out indices [0, n) to the threads
+ * 				and returns once every index has been processed
+ */
+class WorkerPool {
+private:
+	vector<thread> workers;
+	mutex lock;
+	condition_variable wake;
+	condition_variable finished;
+	function<void(int)> job;
+	int jobSize;
+	atomic<int> nextIndex;
+	// Workers still running the current job
+	int busy;
+	unsigned long generation;
+	bool stopping;
+	void work();
+public:
+	WorkerPool(int threads);
+	void parallelFor(int n, function<void(int)> f);
+	virtual ~WorkerPool();
+};
+
+#endif /* _WORKERPOOL_H_ */
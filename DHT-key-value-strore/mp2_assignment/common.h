@@ -7,9 +7,10 @@
 // Transaction Id
 static int g_transID = 0;
 
-// message types, reply is the message from node to coordinator
-enum MessageType {CREATE, READ, UPDATE, DELETE, REPLY, READREPLY};
-// enum of replica types
+// message types, reply is the message from node to coordinator, forward carries a request towards the owners of its key,
+// merkle and sync compare and repair the keys of two replicas
+enum MessageType {CREATE, READ, UPDATE, DELETE, REPLY, READREPLY, FORWARD, MERKLE, SYNC};
+// enum of replica types, every copy past the second is a tertiary one
 enum ReplicaType {PRIMARY, SECONDARY, TERTIARY};
 
 #endif
@@ -0,0 +1,36 @@
+/**********************************
+ * FILE NAME: Check.h
+ *
+ * DESCRIPTION: Checks shared by the test drivers under tests/
+ **********************************/
+
+#ifndef CHECK_H_
+#define CHECK_H_
+
+#include <cstdio>
+
+static int checkFailures = 0;
+
+/**
+ * Report a condition that does not hold and carry on, so one run lists every failure
+ */
+#define CHECK(cond) do { \
+	if ( !(cond) ) { \
+		fprintf(stderr, "%s:%d: CHECK(%s) failed\n", __FILE__, __LINE__, #cond); \
+		checkFailures++; \
+	} \
+} while ( 0 )
+
+/**
+ * Print the outcome of the driver and return its exit status
+ */
+static int checkResult(const char *driver) {
+	if ( checkFailures > 0 ) {
+		fprintf(stderr, "%s: %d checks failed\n", driver, checkFailures);
+		return 1;
+	}
+	printf("%s: all checks passed\n", driver);
+	return 0;
+}
+
+#endif /* CHECK_H_ */
@@ -0,0 +1,141 @@
+/**********************************
+ * FILE NAME: EmulNetTest.cpp
+ *
+ * DESCRIPTION: Test driver of the timer wheel and of the arrival times of EmulNet
+ * 				Usage: EmulNetTest tests/link.conf
+ **********************************/
+
+#include "EmulNet.h"
+#include "Check.h"
+
+/**
+ * FUNCTION NAME: frameDue
+ *
+ * DESCRIPTION: Frame whose size field records the time unit it is due at
+ */
+static en_msg *frameDue(int due) {
+	en_msg *em = (en_msg *) calloc(1, sizeof(en_msg));
+	em->size = due;
+	return em;
+}
+
+/**
+ * FUNCTION NAME: checkWheel
+ *
+ * DESCRIPTION: Schedule frames due on and around the boundaries of every level, and past the top
+ * 				level, with the wheel at start, then tick until the last one is due. Every frame
+ * 				must come out exactly once, at the time unit it is due
+ */
+static void checkWheel(int start) {
+	TimerWheel wheel;
+	vector<en_msg *> expired;
+	vector<int> dues;
+	int last = 0;
+
+	while ( wheel.now < start ) {
+		wheel.tick(expired);
+	}
+	CHECK(expired.empty());
+
+	// The span of the top level is where frames start to overflow
+	for ( int level = 1; level <= WHEEL_LEVELS; level++ ) {
+		int span = 1 << (WHEEL_BITS * level);
+		// The first two boundaries of the level after start
+		int boundary = (start / span + 1) * span;
+		for ( int k = 0; k < 2; k++, boundary += span ) {
+			dues.push_back(boundary - 1);
+			dues.push_back(boundary);
+			dues.push_back(boundary + 1);
+		}
+	}
+	dues.push_back(start + 1);
+	for ( unsigned int i = 0; i < dues.size(); i++ ) {
+		wheel.schedule(dues[i], frameDue(dues[i]));
+		last = max(last, dues[i]);
+	}
+
+	unsigned int delivered = 0;
+	while ( wheel.now < last ) {
+		expired.clear();
+		wheel.tick(expired);
+		for ( unsigned int i = 0; i < expired.size(); i++ ) {
+			CHECK(expired[i]->size == wheel.now);
+			free(expired[i]);
+		}
+		delivered += expired.size();
+	}
+	CHECK(delivered == dues.size());
+	wheel.clear();
+}
+
+/**
+ * Frames node 2 and node 3 received, as (time unit, payload size)
+ */
+static vector<pair<int, int> > arrivals[4];
+static int arrivalNode;
+
+static int enqArrival(void *queue, char *data, int size) {
+	Params *par = (Params *) queue;
+	arrivals[arrivalNode].push_back(make_pair(par->getcurrtime(), size));
+	return 0;
+}
+
+/**
+ * FUNCTION NAME: checkArrivals
+ *
+ * DESCRIPTION: Over links with LINK_DELAY 3 and LINK_BANDWIDTH 1000, where node 2 is slow by 100
+ * 				time units, frames sent at time 0 arrive after the delay, one time unit apart when
+ * 				each fills a link for a whole time unit, and past the first level of the wheel when
+ * 				they go to the slow node
+ */
+static void checkArrivals(Params *par) {
+	EmulNet net(par);
+	Address addr[4];
+	char payload[4000];
+	int full = 1000 - (int)sizeof(en_msg);
+
+	memset(payload, 'x', sizeof(payload));
+	for ( int i = 1; i <= 3; i++ ) {
+		net.ENinit(&addr[i], par->PORTNUM);
+	}
+
+	par->globaltime = 0;
+	for ( int i = 0; i < 3; i++ ) {
+		CHECK(net.ENsend(&addr[1], &addr[3], payload, full) == full);
+	}
+	// Half a time unit on the link, behind nothing else on it
+	CHECK(net.ENsend(&addr[1], &addr[2], payload, 500 - (int)sizeof(en_msg)) > 0);
+
+	for ( par->globaltime = 1; par->globaltime <= 2 * WHEEL_SLOTS; par->globaltime++ ) {
+		for ( arrivalNode = 2; arrivalNode <= 3; arrivalNode++ ) {
+			net.ENrecv(&addr[arrivalNode], enqArrival, NULL, 1, par);
+			net.ENrelease(&addr[arrivalNode]);
+		}
+	}
+
+	CHECK(arrivals[3].size() == 3);
+	for ( unsigned int i = 0; i < arrivals[3].size(); i++ ) {
+		CHECK(arrivals[3][i].first == 4 + (int)i);
+		CHECK(arrivals[3][i].second == full);
+	}
+	CHECK(arrivals[2].size() == 1);
+	if ( arrivals[2].size() == 1 ) {
+		CHECK(arrivals[2][0].first == 103);
+	}
+}
+
+int main(int argc, char *argv[]) {
+	if ( argc < 2 ) {
+		fprintf(stderr, "Usage: %s <test_file>\n", argv[0]);
+		return 1;
+	}
+	Params *par = new Params();
+	par->setparams(argv[1]);
+
+	checkWheel(0);
+	checkWheel(WHEEL_SLOTS - 3);
+	checkWheel((1 << (2 * WHEEL_BITS)) + 5);
+	checkArrivals(par);
+
+	return checkResult("EmulNetTest");
+}
@@ -0,0 +1,121 @@
+/**********************************
+ * FILE NAME: MemberIndexTest.cpp
+ *
+ * DESCRIPTION: Test driver of the hash index over the membership table
+ * 				Usage: MemberIndexTest
+ **********************************/
+
+#include "MemberIndex.h"
+#include "Check.h"
+
+/**
+ * FUNCTION NAME: homeOf
+ *
+ * DESCRIPTION: Slot (id, port) hashes to in a table of size slots, as MemberIndex::slotOf computes it
+ */
+static int homeOf(int id, short port, int size) {
+	return (int)((MemberIndex::pack(id, port) * 0x9E3779B97F4A7C15ULL) >> 40) & (size - 1);
+}
+
+/**
+ * FUNCTION NAME: checkIndexed
+ *
+ * DESCRIPTION: The index finds exactly the ids of expected, at their positions
+ */
+static void checkIndexed(MemberIndex &index, vector<int> &ids, map<int, int> &expected) {
+	for ( unsigned int i = 0; i < ids.size(); i++ ) {
+		map<int, int>::iterator it = expected.find(ids[i]);
+		CHECK(index.find(ids[i], 0) == (it == expected.end() ? -1 : it->second));
+	}
+	CHECK(index.size() == (int)expected.size());
+}
+
+/**
+ * FUNCTION NAME: checkBackwardShift
+ *
+ * DESCRIPTION: Fill a 16 slot table with one run of ids that share the home slot home, followed
+ * 				by ids whose home is the next slot, then erase them in every order. After each erase
+ * 				the entries left must still be found, so the shift may never move an entry before
+ * 				its home slot nor leave a hole inside a run. home 15 makes the run wrap around
+ */
+static void checkBackwardShift(int home) {
+	vector<int> ids;
+	int shared = 0;
+	for ( int id = 1; ids.size() < 7; id++ ) {
+		int h = homeOf(id, 0, 16);
+		if ( h == home && shared < 4 ) {
+			ids.push_back(id);
+			shared++;
+		}
+		else if ( h == ((home + 1) & 15) && (int)ids.size() - shared < 3 ) {
+			ids.push_back(id);
+		}
+	}
+
+	sort(ids.begin(), ids.end());
+	do {
+		MemberIndex index;
+		map<int, int> expected;
+		for ( unsigned int i = 0; i < ids.size(); i++ ) {
+			index.set(ids[i], 0, i);
+			expected[ids[i]] = i;
+		}
+		checkIndexed(index, ids, expected);
+		for ( unsigned int i = 0; i < ids.size(); i++ ) {
+			index.erase(ids[i], 0);
+			expected.erase(ids[i]);
+			checkIndexed(index, ids, expected);
+		}
+	} while ( next_permutation(ids.begin(), ids.end()) );
+}
+
+/**
+ * FUNCTION NAME: checkAgainstMap
+ *
+ * DESCRIPTION: Random sets, moves and erases across several rounds of growth, compared with a map
+ */
+static void checkAgainstMap() {
+	MemberIndex index;
+	map<unsigned long long, int> expected;
+	unsigned int state = 12345;
+
+	for ( int op = 0; op < 200000; op++ ) {
+		// xorshift32
+		state ^= state << 13;
+		state ^= state >> 17;
+		state ^= state << 5;
+		int id = state % 3000;
+		short port = (state >> 16) % 3;
+		if ( (state >> 20) % 3 ) {
+			index.set(id, port, op);
+			expected[MemberIndex::pack(id, port)] = op;
+		}
+		else {
+			index.erase(id, port);
+			expected.erase(MemberIndex::pack(id, port));
+		}
+		if ( 0 == op % 1000 ) {
+			CHECK(index.size() == (int)expected.size());
+		}
+	}
+	for ( int id = 0; id < 3000; id++ ) {
+		for ( short port = 0; port < 3; port++ ) {
+			map<unsigned long long, int>::iterator it = expected.find(MemberIndex::pack(id, port));
+			CHECK(index.find(id, port) == (it == expected.end() ? -1 : it->second));
+		}
+	}
+
+	index.clear();
+	CHECK(0 == index.size());
+	CHECK(-1 == index.find(1, 0));
+	index.erase(1, 0);
+	CHECK(0 == index.size());
+}
+
+int main() {
+	checkBackwardShift(3);
+	checkBackwardShift(15);
+	checkAgainstMap();
+
+	return checkResult("MemberIndexTest");
+}
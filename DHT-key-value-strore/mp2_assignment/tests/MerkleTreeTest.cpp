@@ -0,0 +1,189 @@
+/**********************************
+ * FILE NAME: MerkleTreeTest.cpp
+ *
+ * DESCRIPTION: Test driver of the hash tree over the positions of the ring
+ * 				Usage: MerkleTreeTest
+ **********************************/
+
+#include "MerkleTree.h"
+#include "Check.h"
+
+/**
+ * FUNCTION NAME: sameTree
+ *
+ * DESCRIPTION: Whether a and b, of the same size, are equal node by node
+ */
+static bool sameTree(const MerkleTree &a, const MerkleTree &b) {
+	for ( int i = 1; a.valid(i); i++ ) {
+		if ( a.hash(i) != b.hash(i) ) {
+			return false;
+		}
+	}
+	return true;
+}
+
+/**
+ * FUNCTION NAME: spanOf
+ *
+ * DESCRIPTION: First and last position under node in a tree of size positions
+ */
+static pair<int, int> spanOf(int node, int size) {
+	int depth = 0;
+	while ( (2 << depth) <= node ) {
+		depth++;
+	}
+	int width = size >> depth;
+	int first = (node - (1 << depth)) * width;
+	return make_pair(first, first + width - 1);
+}
+
+/**
+ * FUNCTION NAME: diff
+ *
+ * DESCRIPTION: Positions whose entries differ between a and b, found the way anti-entropy finds
+ * 				them: from the nodes that cover the range down through the children that differ
+ */
+static vector<size_t> diff(const MerkleTree &a, const MerkleTree &b, size_t from, size_t to) {
+	vector<int> pending;
+	vector<size_t> leaves;
+	a.cover(from, to, pending);
+	while ( !pending.empty() ) {
+		int node = pending.back();
+		pending.pop_back();
+		if ( a.hash(node) == b.hash(node) ) {
+			continue;
+		}
+		if ( a.isLeaf(node) ) {
+			leaves.push_back(a.positionOf(node));
+			continue;
+		}
+		pending.push_back(2 * node);
+		pending.push_back(2 * node + 1);
+	}
+	sort(leaves.begin(), leaves.end());
+	return leaves;
+}
+
+/**
+ * FUNCTION NAME: checkToggle
+ *
+ * DESCRIPTION: Entries come and go in any order: the same entries toggled in another order give
+ * 				the same tree, toggling an entry twice takes it out again, and entries swapped
+ * 				between two positions change the tree
+ */
+static void checkToggle(int size) {
+	MerkleTree empty(size), a(size), b(size);
+	vector<pair<size_t, string> > entries;
+	for ( int i = 0; i < 3 * size; i++ ) {
+		entries.push_back(make_pair((size_t)((i * 7919) % size), "key" + to_string(i)));
+	}
+
+	for ( unsigned int i = 0; i < entries.size(); i++ ) {
+		a.toggle(entries[i].first, entries[i].second, "value");
+	}
+	for ( int i = entries.size() - 1; i >= 0; i-- ) {
+		b.toggle(entries[i].first, entries[i].second, "value");
+	}
+	CHECK(sameTree(a, b));
+	CHECK(!sameTree(a, empty));
+
+	for ( unsigned int i = 0; i < entries.size(); i += 2 ) {
+		b.toggle(entries[i].first, entries[i].second, "value");
+		b.toggle(entries[i].first, entries[i].second, "value");
+	}
+	CHECK(sameTree(a, b));
+	for ( unsigned int i = 0; i < entries.size(); i++ ) {
+		b.toggle(entries[i].first, entries[i].second, "value");
+	}
+	CHECK(sameTree(b, empty));
+
+	MerkleTree left(size), right(size);
+	left.toggle(0, "k0", "v");
+	left.toggle(1, "k1", "v");
+	right.toggle(0, "k1", "v");
+	right.toggle(1, "k0", "v");
+	CHECK(left.hash(1) != right.hash(1));
+}
+
+/**
+ * FUNCTION NAME: checkDiff
+ *
+ * DESCRIPTION: Trees that differ in a few entries, or in the value of one, lead the descent to
+ * 				exactly the positions of those entries and nothing else, within any range
+ */
+static void checkDiff(int size) {
+	MerkleTree a(size), b(size);
+	for ( int pos = 0; pos < size; pos++ ) {
+		a.toggle(pos, "key" + to_string(pos), "value");
+		b.toggle(pos, "key" + to_string(pos), "value");
+	}
+	CHECK(diff(a, b, 0, size - 1).empty());
+
+	vector<size_t> expected;
+	expected.push_back(0);
+	expected.push_back(size / 2 - 1);
+	expected.push_back(size / 2);
+	expected.push_back(size - 1);
+	// A missing entry, an extra one, a changed value and an extra one again
+	b.toggle(expected[0], "key0", "value");
+	b.toggle(expected[1], "extra", "value");
+	b.toggle(expected[2], "key" + to_string(expected[2]), "value");
+	b.toggle(expected[2], "key" + to_string(expected[2]), "changed");
+	b.toggle(expected[3], "extra", "value");
+	CHECK(diff(a, b, 0, size - 1) == expected);
+
+	// Only the differences inside the range are found
+	vector<size_t> inside(expected.begin() + 1, expected.begin() + 3);
+	CHECK(diff(a, b, 1, size - 2) == inside);
+	CHECK(diff(a, b, size / 2, size / 2) == vector<size_t>(1, size / 2));
+	CHECK(diff(a, b, 1, size / 2 - 2).empty());
+}
+
+/**
+ * FUNCTION NAME: checkCover
+ *
+ * DESCRIPTION: For every range of a small tree the nodes cover spans every position of the range
+ * 				exactly once and nothing outside it, with at most two nodes per level
+ */
+static void checkCover(int size) {
+	int levels = 0;
+	while ( (1 << levels) < size ) {
+		levels++;
+	}
+	MerkleTree tree(size);
+	for ( int from = 0; from < size; from++ ) {
+		for ( int to = from; to < size; to++ ) {
+			vector<int> nodes;
+			tree.cover(from, to, nodes);
+			vector<int> seen(size, 0);
+			for ( unsigned int i = 0; i < nodes.size(); i++ ) {
+				CHECK(tree.valid(nodes[i]));
+				pair<int, int> span = spanOf(nodes[i], size);
+				for ( int pos = span.first; pos <= span.second; pos++ ) {
+					seen[pos]++;
+				}
+			}
+			for ( int pos = 0; pos < size; pos++ ) {
+				CHECK(seen[pos] == (pos >= from && pos <= to ? 1 : 0));
+			}
+			CHECK((int)nodes.size() <= 2 * (levels + 1));
+		}
+	}
+	for ( int pos = 0; pos < size; pos++ ) {
+		CHECK(tree.isLeaf(size + pos));
+		CHECK(tree.positionOf(size + pos) == (size_t)pos);
+	}
+	CHECK(!tree.isLeaf(size - 1));
+	CHECK(!tree.valid(0));
+	CHECK(!tree.valid(2 * size));
+}
+
+int main() {
+	checkToggle(16);
+	checkToggle(RING_SIZE);
+	checkDiff(16);
+	checkDiff(RING_SIZE);
+	checkCover(32);
+
+	return checkResult("MerkleTreeTest");
+}
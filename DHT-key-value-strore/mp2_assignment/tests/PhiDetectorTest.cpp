@@ -0,0 +1,114 @@
+/**********************************
+ * FILE NAME: PhiDetectorTest.cpp
+ *
+ * DESCRIPTION: Test driver of the phi accrual failure detector
+ * 				Usage: PhiDetectorTest
+ **********************************/
+
+#include "PhiDetector.h"
+#include "Check.h"
+
+/**
+ * FUNCTION NAME: near
+ *
+ * DESCRIPTION: Whether a and b differ by at most tolerance
+ */
+static bool near(double a, double b, double tolerance) {
+	return fabs(a - b) <= tolerance;
+}
+
+/**
+ * FUNCTION NAME: checkWindow
+ *
+ * DESCRIPTION: A member not heard from yet has the prior of PHI_FIRST_INTERVAL, intervals that
+ * 				are not positive are ignored, and once PHI_WINDOW intervals came the mean and
+ * 				deviation are those of the last PHI_WINDOW alone
+ */
+static void checkWindow() {
+	PhiDetector fresh;
+	CHECK(near(fresh.mean(), PHI_FIRST_INTERVAL, 1e-9));
+	CHECK(fresh.stddev() >= PHI_MIN_STDDEV);
+
+	fresh.arrival(0);
+	fresh.arrival(-5);
+	CHECK(near(fresh.mean(), PHI_FIRST_INTERVAL, 1e-9));
+
+	PhiDetector detector;
+	vector<int> seen;
+	for ( int i = 0; i < 5 * PHI_WINDOW; i++ ) {
+		int interval = 3 + (i * 7) % 11;
+		detector.arrival(interval);
+		seen.push_back(interval);
+		if ( (int)seen.size() < PHI_WINDOW ) {
+			continue;
+		}
+		double sum = 0, squares = 0;
+		for ( int k = seen.size() - PHI_WINDOW; k < (int)seen.size(); k++ ) {
+			sum += seen[k];
+			squares += (double)seen[k] * seen[k];
+		}
+		double mean = sum / PHI_WINDOW;
+		double deviation = sqrt(squares / PHI_WINDOW - mean * mean);
+		CHECK(near(detector.mean(), mean, 1e-9));
+		CHECK(near(detector.stddev(), max(PHI_MIN_STDDEV, deviation), 1e-9));
+	}
+}
+
+/**
+ * FUNCTION NAME: checkPhi
+ *
+ * DESCRIPTION: phi never decreases with the silence, is -log10(1/2) when the silence is the mean
+ * 				interval, and stays within 10% of -log10 of the normal tail a few deviations out
+ */
+static void checkPhi() {
+	PhiDetector detector;
+	for ( int i = 0; i < PHI_WINDOW; i++ ) {
+		detector.arrival(i % 2 ? 6 : 14);
+	}
+	double mean = detector.mean(), deviation = detector.stddev();
+	CHECK(near(mean, 10, 1e-9));
+	CHECK(near(deviation, 4, 1e-9));
+
+	CHECK(near(detector.phi(10), -log10(0.5), 1e-9));
+	CHECK(detector.phi(0) >= 0);
+	double previous = -1;
+	for ( long elapsed = 0; elapsed <= 40; elapsed++ ) {
+		double phi = detector.phi(elapsed);
+		CHECK(phi >= previous);
+		previous = phi;
+	}
+	for ( double y = 0.5; y <= 4; y += 0.5 ) {
+		double tail = -log10(0.5 * erfc(y / sqrt(2.0)));
+		double phi = detector.phi((long)(mean + y * deviation));
+		CHECK(fabs(phi - tail) <= 0.1 * tail);
+	}
+}
+
+/**
+ * FUNCTION NAME: checkIrregular
+ *
+ * DESCRIPTION: Of two members with the same mean interval, the one heard irregularly is given
+ * 				more time, and one heard like clockwork is not suspected after one late heartbeat
+ */
+static void checkIrregular() {
+	PhiDetector regular, irregular;
+	for ( int i = 0; i < PHI_WINDOW; i++ ) {
+		regular.arrival(8);
+		irregular.arrival(i % 2 ? 2 : 14);
+	}
+	CHECK(near(regular.mean(), irregular.mean(), 1e-9));
+	CHECK(near(regular.stddev(), PHI_MIN_STDDEV, 1e-9));
+	for ( long elapsed = 12; elapsed <= 30; elapsed++ ) {
+		CHECK(irregular.phi(elapsed) < regular.phi(elapsed));
+	}
+	// Two deviations late is barely suspicious
+	CHECK(regular.phi(8 + 2 * (long)PHI_MIN_STDDEV) < 3);
+}
+
+int main() {
+	checkWindow();
+	checkPhi();
+	checkIrregular();
+
+	return checkResult("PhiDetectorTest");
+}